@@ -0,0 +1,54 @@
+/*
+ * Atomic.h
+ * Relaxed atomic access to weights shared by hogwild! threads
+ */
+
+#ifndef ATOMIC_HEADER
+#define ATOMIC_HEADER
+
+/*
+ * The weights stay plain arrays so Eigen can still use them, but
+ * every access from the training threads goes through these, so each
+ * element is read and written whole and concurrent updates add up
+ * instead of overwriting each other. Relaxed order is enough, hogwild!
+ * needs no ordering between different weights
+ */
+
+template <typename T>
+inline T relaxed_load(const T *p) {
+    T v;
+    __atomic_load(p, &v, __ATOMIC_RELAXED);
+    return v;
+}
+
+template <typename T>
+inline void relaxed_store(T *p, T v) {
+    __atomic_store(p, &v, __ATOMIC_RELAXED);
+}
+
+/*
+ * *p += d as one lock-free read-modify-write
+ */
+template <typename T>
+inline void relaxed_add(T *p, T d) {
+    T old = relaxed_load(p);
+    T sum = old + d;
+    while (!__atomic_compare_exchange(p, &old, &sum, true,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        sum = old + d;
+    }
+}
+
+/*
+ * *p = max(*p, v) as one lock-free read-modify-write, return the old *p
+ */
+template <typename T>
+inline T relaxed_max(T *p, T v) {
+    T old = relaxed_load(p);
+    while (old < v && !__atomic_compare_exchange(p, &old, &v, true,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    return old;
+}
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Batcher.cpp
+ * The definition of class Batcher
+ */
+
+#include "Batcher.h"
+#include "Log.h"
+#include "Stopwatch.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+
+Batcher::Batcher(const Scorer &scorer, int max_batch, int wait_us) {
+    m_scorer = scorer;
+    m_max_batch = max(max_batch, 1);
+    m_wait = wait_us * 1e-6;
+    m_stop = false;
+    m_batches = 0;
+    m_thread = thread(&Batcher::run, this);
+}
+
+Batcher::~Batcher() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+}
+
+void Batcher::submit(Request *req) {
+    req->start = wall_time();
+    bool wake;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_queue.push_back(req);
+        // the scoring thread only needs waking for the first request
+        // of a batch and when the batch is full
+        wake = m_queue.size() == 1 || (int)m_queue.size() >= m_max_batch;
+    }
+    if (wake) {
+        m_cond.notify_one();
+    }
+}
+
+void Batcher::run() {
+    Dataset batch;
+    vector<Request *> reqs;
+    vector<pair<int, double>> pred;
+    while (true) {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] {
+                return m_stop || !m_queue.empty();
+            });
+            if (m_queue.empty()) {
+                return;
+            }
+            // give the batch until the deadline of its oldest request
+            // to fill up
+            chrono::steady_clock::time_point deadline =
+                chrono::steady_clock::now() + chrono::microseconds(
+                    (long long)((m_queue.front()->start + m_wait
+                            - wall_time()) * 1e6));
+            m_cond.wait_until(lock, deadline, [this] {
+                return m_stop || (int)m_queue.size() >= m_max_batch;
+            });
+            int n = min((int)m_queue.size(), m_max_batch);
+            reqs.assign(m_queue.begin(), m_queue.begin() + n);
+            m_queue.erase(m_queue.begin(), m_queue.begin() + n);
+        }
+
+        batch.clear();
+        for (Request *req : reqs) {
+            SampleView s;
+            s.label = 0;
+            s.len = req->feat.size();
+            s.feat = req->feat.data();
+            batch.append(s);
+        }
+        m_scorer(batch, pred);
+
+        double end = wall_time();
+        {
+            lock_guard<mutex> lock(m_stat_mutex);
+            for (Request *req : reqs) {
+                m_latency.push_back((end - req->start) * 1e6);
+            }
+            m_batches++;
+        }
+        for (int i=0; i<(int)reqs.size(); i++) {
+            Request *req = reqs[i];
+            lock_guard<mutex> lock(*req->mutex);
+            req->result = pred[i];
+            req->done = true;
+            req->cond->notify_all();
+        }
+    }
+}
+
+void Batcher::report() {
+    vector<float> latency;
+    long long batches;
+    {
+        lock_guard<mutex> lock(m_stat_mutex);
+        latency.swap(m_latency);
+        batches = m_batches;
+        m_batches = 0;
+    }
+    if (latency.empty()) {
+        return;
+    }
+    size_t n = latency.size();
+    nth_element(latency.begin(), latency.begin() + n / 2, latency.end());
+    float p50 = latency[n / 2];
+    nth_element(latency.begin(), latency.begin() + n * 99 / 100,
+            latency.end());
+    float p99 = latency[n * 99 / 100];
+    LOG("requests: %zu, avg batch: %.1f, p50: %.1fus, p99: %.1fus\n",
+            n, (double)n / batches, p50, p99);
+}
@@ -0,0 +1,88 @@
+/*
+ * Batcher.h
+ * The declaration of class Batcher
+ */
+
+#ifndef BATCHER_HEADER
+#define BATCHER_HEADER
+
+#include "Sample.h"
+#include "Dataset.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <utility>
+
+/*
+ * One sample to score. The submitter owns it and waits on cond under
+ * mutex until done is set
+ */
+struct Request {
+    std::vector<RawFeat> feat;
+    std::pair<int, double> result;
+    bool done;
+    // when the request was submitted, in seconds
+    double start;
+    std::mutex *mutex;
+    std::condition_variable *cond;
+};
+
+/*
+ * Collects the requests of all connections into micro batches and
+ * scores them on one thread. A batch is scored once it has max_batch
+ * requests or its oldest request waited wait_us microseconds, so
+ * concurrent requests share one forward pass while a lone request is
+ * only delayed by wait_us. Keeps the latency of every request from
+ * submit to done for the p50/p99 report
+ */
+class Batcher {
+    public:
+        typedef std::function<void(Dataset &,
+                std::vector<std::pair<int, double>> &)> Scorer;
+
+        Batcher(const Scorer &scorer, int max_batch, int wait_us);
+        /*
+         * score the queued requests and stop the scoring thread
+         */
+        ~Batcher();
+
+        /*
+         * queue a request, its result is ready when done is set.
+         * The submitter clears done before
+         */
+        void submit(Request *req);
+        /*
+         * log the count, batch size and p50/p99 latency of the
+         * requests scored since the last report
+         */
+        void report();
+    private:
+        Batcher(const Batcher &);
+        Batcher &operator=(const Batcher &);
+
+        void run();
+
+        Scorer m_scorer;
+        int m_max_batch;
+        double m_wait;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::deque<Request *> m_queue;
+        bool m_stop;
+
+        /*
+         * the latency in microseconds of the requests and the number
+         * of batches since the last report, guarded by m_stat_mutex
+         */
+        std::mutex m_stat_mutex;
+        std::vector<float> m_latency;
+        long long m_batches;
+
+        std::thread m_thread;
+};
+
+#endif
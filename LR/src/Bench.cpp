@@ -0,0 +1,379 @@
+/*
+ * Bench.cpp
+ * Throughput benchmarks of loading, the training kernels and whole
+ * epochs on a synthetic dataset
+ */
+
+#include "LR.h"
+#include "Utils.h"
+#include "Log.h"
+#include "Stopwatch.h"
+#include "FeatureHash.h"
+#include "CompactFile.h"
+#include "Softmax.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+/*
+ * The options of the benchmark, given as key=value arguments
+ */
+struct BenchConfig {
+    // where the synthetic dataset is written
+    string filename;
+    int samples;
+    // features per sample
+    int nnz;
+    int feature_size;
+    int class_cnt;
+    int batch_size;
+    // the largest thread count of the scaling curve
+    int threads;
+    // the epochs timed per thread count
+    int epochs;
+    // each micro benchmark reports the best of reps runs
+    int reps;
+    string precision;
+    string simd;
+
+    BenchConfig() {
+        filename = "./bench.bin";
+        samples = 200000;
+        nnz = 32;
+        feature_size = 100000;
+        class_cnt = 5;
+        batch_size = 1000;
+        threads = max(1, (int)thread::hardware_concurrency());
+        epochs = 3;
+        reps = 3;
+        precision = "double";
+        simd = "auto";
+    }
+
+    void parse(int argc, char **argv) {
+        for (int i=1; i<argc; i++) {
+            const char *eq = strchr(argv[i], '=');
+            if (eq == NULL) {
+                throw "bench options are key=value";
+            }
+            string key(argv[i], eq - argv[i]);
+            string val(eq + 1);
+            if (key == "filename") {
+                filename = val;
+            }
+            else if (key == "samples") {
+                samples = atoi(val.c_str());
+            }
+            else if (key == "nnz") {
+                nnz = atoi(val.c_str());
+            }
+            else if (key == "feature_size") {
+                feature_size = atoi(val.c_str());
+            }
+            else if (key == "class_cnt") {
+                class_cnt = atoi(val.c_str());
+            }
+            else if (key == "batch_size") {
+                batch_size = atoi(val.c_str());
+            }
+            else if (key == "threads") {
+                threads = atoi(val.c_str());
+            }
+            else if (key == "epochs") {
+                epochs = atoi(val.c_str());
+            }
+            else if (key == "reps") {
+                reps = atoi(val.c_str());
+            }
+            else if (key == "precision") {
+                precision = val;
+            }
+            else if (key == "simd") {
+                simd = val;
+            }
+            else {
+                throw "unseen bench option";
+            }
+        }
+        if (samples < 1 || nnz < 1 || feature_size < class_cnt
+                || class_cnt < 2 || batch_size < 1 || threads < 1
+                || epochs < 1 || reps < 1) {
+            throw "bench options out of range";
+        }
+    }
+
+    /*
+     * the model config of a run on thread_cnt threads
+     */
+    Config model(int thread_cnt) const {
+        Config c;
+        c.feature_size = feature_size;
+        c.class_cnt = class_cnt;
+        c.alpha = 0.01;
+        c.lambda = 0.0001;
+        c.momentum = 0.5;
+        c.batch_size = batch_size;
+        c.iter_cnt = epochs;
+        c.thread_cnt = thread_cnt;
+        c.precision = precision;
+        return c;
+    }
+};
+
+/*
+ * Write samples records of nnz binary features to a .bin file. The ids
+ * are skewed towards the low ones like real vocabularies, and half of
+ * them come from a range of the label so the classes can be learned
+ */
+void generate(const BenchConfig &bc) {
+    FILE *fo = fopen(bc.filename.c_str(), "wb");
+    if (fo == NULL) {
+        throw "cannot open bench file";
+    }
+    srandom(1);
+    int range = bc.feature_size / bc.class_cnt;
+    vector<int> record(2 * (bc.nnz + 1));
+    for (int i=0; i<bc.samples; i++) {
+        int label = random() % bc.class_cnt;
+        record[0] = record.size() * sizeof(int);
+        record[1] = label + 1;
+        for (int k=0; k<bc.nnz; k++) {
+            int id;
+            if (k % 2 == 0) {
+                id = label * range + random() % range;
+            }
+            else {
+                double u = random() / (double)RAND_MAX;
+                id = min((int)(bc.feature_size * u * u * u),
+                        bc.feature_size - 1);
+            }
+            float value = 1;
+            record[2 * k + 2] = id + 1;
+            memcpy(&record[2 * k + 3], &value, sizeof(float));
+        }
+        fwrite(record.data(), sizeof(int), record.size(), fo);
+    }
+    fclose(fo);
+}
+
+/*
+ * The benchmarks of the private kernels of LR, each on thread 0 of
+ * the model over the whole of data
+ */
+template <typename Real>
+class LRBench {
+    public:
+        LRBench(LR<Real> &lr, Dataset &data) : m_lr(lr) {
+            m_lr.init_weights();
+            m_lr.m_data = &data;
+            int n = data.size();
+            m_lr.m_idx.resize(n);
+            for (int i=0; i<n; i++) {
+                m_lr.m_idx[i] = i;
+            }
+            random_permutation(m_lr.m_idx);
+        }
+        ~LRBench() {
+            m_lr.m_data = NULL;
+        }
+
+        /*
+         * copy every minibatch into the workspace
+         */
+        double gather() {
+            int n = m_lr.m_idx.size();
+            double start = wall_time();
+            for (int st=0; st<n; st+=m_lr.m_batch_size) {
+                m_lr.gather(st, min(st + m_lr.m_batch_size, n), 0);
+            }
+            return wall_time() - start;
+        }
+
+        /*
+         * score every block of predict_batch samples
+         */
+        double forward() {
+            Workspace<Real> &ws = *m_lr.m_ws[0];
+            int n = m_lr.m_data->size();
+            int block = m_lr.m_predict_batch;
+            ws.scores.resize((size_t)m_lr.m_output_size * block);
+            ws.pred.resize(block);
+            double start = wall_time();
+            for (int st=0; st<n; st+=block) {
+                (m_lr.*m_lr.m_predict_block)(st, min(st + block, n),
+                        ws.scores.data(), ws.pred.data());
+            }
+            return wall_time() - start;
+        }
+
+        /*
+         * train every minibatch, timing only the kernel and not the
+         * gather before it
+         */
+        double train_mini_batch() {
+            int n = m_lr.m_idx.size();
+            int b = m_lr.m_batch_size;
+            m_lr.build_decay((n + b - 1) / b + 1);
+            double time = 0;
+            for (int st=0; st<n; st+=b) {
+                m_lr.gather(st, min(st + b, n), 0);
+                double start = wall_time();
+                (m_lr.*m_lr.m_train_mini_batch)(min(st + b, n), 0);
+                time += wall_time() - start;
+            }
+            if (m_lr.m_optimizer == OPT_SGD) {
+                (m_lr.*m_lr.m_flush)();
+            }
+            return time;
+        }
+    private:
+        LR<Real> &m_lr;
+};
+
+/*
+ * the best of reps runs of f
+ */
+template <typename F>
+double best(int reps, F f) {
+    double t = f();
+    for (int i=1; i<reps; i++) {
+        t = min(t, f());
+    }
+    return t;
+}
+
+template <typename Real>
+void bench(const BenchConfig &bc) {
+    LOG("samples: %d, nnz: %d, feature_size: %d, class_cnt: %d, "
+            "batch_size: %d, precision: %s\n", bc.samples, bc.nnz,
+            bc.feature_size, bc.class_cnt, bc.batch_size,
+            bc.precision.c_str());
+    double mb = (double)bc.samples * (bc.nnz + 1) * 8 / (1 << 20);
+    double t = 0;
+    // one thread, all threads, and all threads with the offset index
+    // sidecar, which the first of its runs writes
+    for (int mode=0; mode<3; mode++) {
+        int threads = mode == 0 ? 1 : bc.threads;
+        bool use_index = mode == 2;
+        t = best(bc.reps, [&bc, threads, use_index] {
+                double start = wall_time();
+                delete read_sample(bc.filename.c_str(), threads, use_index);
+                return wall_time() - start;
+                });
+        LOG("read_sample %d threads%s: %.4fs, %.0f samples/s, "
+                "%.1f MB/s\n", threads, use_index ? " indexed" : "", t,
+                bc.samples / t, mb / t);
+    }
+    remove((bc.filename + ".idx").c_str());
+
+    Dataset *data = read_sample(bc.filename.c_str(), bc.threads);
+
+    // the same samples in the compact format
+    string compact = bc.filename + ".lrc";
+    write_compact(*data, compact.c_str());
+    FILE *fc = fopen(compact.c_str(), "rb");
+    fseek(fc, 0, SEEK_END);
+    double compact_mb = (double)ftell(fc) / (1 << 20);
+    fclose(fc);
+    LOG("compact file: %.1f MB, %.2fx smaller\n", compact_mb,
+            mb / compact_mb);
+    for (int threads : {1, bc.threads}) {
+        t = best(bc.reps, [&compact, threads] {
+                double start = wall_time();
+                delete read_sample(compact.c_str(), threads);
+                return wall_time() - start;
+                });
+        LOG("read_sample %d threads compact: %.4fs, %.0f samples/s\n",
+                threads, t, bc.samples / t);
+    }
+    remove(compact.c_str());
+    prepare_features(*data, bc.feature_size, bc.class_cnt, 0, NULL);
+    {
+        Log::set_quiet(true);
+        LR<Real> lr(bc.model(1));
+        LRBench<Real> kernels(lr, *data);
+        Log::set_quiet(false);
+        t = best(bc.reps, [&kernels] { return kernels.gather(); });
+        LOG("gather: %.4fs, %.0f samples/s\n", t, bc.samples / t);
+        t = best(bc.reps, [&kernels] { return kernels.forward(); });
+        LOG("forward: %.4fs, %.0f samples/s\n", t, bc.samples / t);
+        t = best(bc.reps, [&kernels] {
+                return kernels.train_mini_batch(); });
+        LOG("train_mini_batch: %.4fs, %.0f samples/s\n", t,
+                bc.samples / t);
+    }
+
+    // the scaling curve, doubling the threads up to bc.threads
+    vector<int> counts;
+    for (int c=1; c<bc.threads; c*=2) {
+        counts.push_back(c);
+    }
+    counts.push_back(bc.threads);
+    LOG("threads, epoch, train samples/s, speedup, "
+            "predict samples/s, speedup\n");
+    double train_base = 0;
+    double predict_base = 0;
+    for (int c : counts) {
+        double train_time;
+        double predict_time;
+        Log::set_quiet(true);
+        {
+            LR<Real> lr(bc.model(c));
+            double start = wall_time();
+            lr.fit(*data, NULL);
+            train_time = (wall_time() - start) / lr.loss_history().size();
+            predict_time = best(bc.reps, [&lr, data] {
+                    double acc;
+                    double rmse;
+                    double start = wall_time();
+                    lr.evaluate(*data, acc, rmse);
+                    return wall_time() - start;
+                    });
+        }
+        Log::set_quiet(false);
+        double train_rate = bc.samples / train_time;
+        double predict_rate = bc.samples / predict_time;
+        if (c == 1) {
+            train_base = train_rate;
+            predict_base = predict_rate;
+        }
+        LOG("%d, %.4fs, %.0f, %.2f, %.0f, %.2f\n", c, train_time,
+                train_rate, train_rate / train_base, predict_rate,
+                predict_rate / predict_base);
+    }
+    delete data;
+}
+
+/*
+ * The main routine, generates the dataset and runs every benchmark
+ */
+int main(int argc, char **argv) {
+    BenchConfig bc;
+    bc.parse(argc, argv);
+
+    Log::initialize("bench_log.txt");
+    softmax_select(bc.simd);
+
+    LOG("generate %s\n", bc.filename.c_str());
+    generate(bc);
+    if (bc.precision == "double") {
+        bench<double>(bc);
+    }
+    else if (bc.precision == "float") {
+        bench<float>(bc);
+    }
+    else {
+        throw "unknown precision";
+    }
+    remove(bc.filename.c_str());
+
+    Log::close();
+
+    return 0;
+}
@@ -0,0 +1,293 @@
+/*
+ * CompactFile.cpp
+ * The definition of the compact feature file format
+ */
+
+#include "CompactFile.h"
+#include "ThreadPool.h"
+#include <cstring>
+#include <cstdio>
+#include <climits>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+static const char COMPACT_MAGIC[8] = "LRCFEAT";
+
+/*
+ * append v as a little endian base 128 varint
+ */
+static void put_varint(string &out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+/*
+ * read one varint at p, before end
+ */
+static inline uint32_t get_varint(const unsigned char *&p,
+        const unsigned char *end) {
+    uint32_t v = 0;
+    for (int shift=0; shift<35; shift+=7) {
+        if (p >= end) {
+            break;
+        }
+        unsigned char b = *p++;
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            return v;
+        }
+    }
+    throw "corrupted compact file";
+}
+
+/*
+ * Read the len features of a binary record at p into f, summing the id
+ * deltas up into the ids. Sorted ids of common features are mostly
+ * less than 128 apart, so eight deltas in a row usually fit one byte
+ * each. Those are found with one mask test on an 8 byte word and added
+ * up without the byte by byte varint loop
+ */
+static inline void get_binary_feats(const unsigned char *&p,
+        const unsigned char *end, int len, Feat *f) {
+    const uint64_t high = 0x8080808080808080ULL;
+    uint64_t id = 0;
+    int k = 0;
+    while (k < len) {
+        if (len - k >= 8 && end - p >= 8) {
+            uint64_t w;
+            memcpy(&w, p, sizeof(w));
+            if ((w & high) == 0) {
+                for (int j=0; j<8; j++) {
+                    id += (w >> (8 * j)) & 0xff;
+                    f[k + j].id = (int)id;
+                    f[k + j].value = 1;
+                }
+                p += 8;
+                k += 8;
+                if (id > INT_MAX) {
+                    throw "corrupted compact file";
+                }
+                continue;
+            }
+        }
+        id += get_varint(p, end);
+        if (id > INT_MAX) {
+            throw "corrupted compact file";
+        }
+        f[k].id = (int)id;
+        f[k].value = 1;
+        k++;
+    }
+}
+
+/*
+ * Read the len features of a record with values at p into f, each a
+ * delta with the valued bit, followed by the value if it is set
+ */
+static inline void get_feats(const unsigned char *&p,
+        const unsigned char *end, int len, Feat *f) {
+    uint64_t id = 0;
+    for (int k=0; k<len; k++) {
+        uint32_t v = get_varint(p, end);
+        id += v >> 1;
+        if (id > INT_MAX) {
+            throw "corrupted compact file";
+        }
+        f[k].id = (int)id;
+        if (v & 1) {
+            if ((size_t)(end - p) < sizeof(float)) {
+                throw "corrupted compact file";
+            }
+            memcpy(&f[k].value, p, sizeof(float));
+            p += sizeof(float);
+        }
+        else {
+            f[k].value = 1;
+        }
+    }
+}
+
+bool is_compact_file(const char *filename) {
+    FILE *fi = fopen(filename, "rb");
+    if (fi == NULL) {
+        return false;
+    }
+    char magic[8];
+    bool compact = fread(magic, sizeof(magic), 1, fi) == 1
+        && memcmp(magic, COMPACT_MAGIC, sizeof(magic)) == 0;
+    fclose(fi);
+    return compact;
+}
+
+void write_compact(const Dataset &data, const char *filename) {
+    CompactHeader header;
+    memcpy(header.magic, COMPACT_MAGIC, sizeof(header.magic));
+    header.version = COMPACT_VERSION;
+    header.block_records = COMPACT_BLOCK_RECORDS;
+    header.record_cnt = data.size();
+    header.nnz = data.nnz();
+    // check before the tmp file is opened, nothing is left behind
+    for (const Feat &f : data.feats) {
+        if (f.id < 0) {
+            throw "negative feature id";
+        }
+    }
+
+    AtomicFile fo;
+    if (!fo.open(filename)) {
+        throw "cannot open compact file";
+    }
+    fo.write(&header, sizeof(header));
+    uint64_t offset = sizeof(header);
+    vector<CompactBlock> blocks;
+    vector<Feat> feats;
+    string out;
+    for (int st=0; st<data.size(); st+=COMPACT_BLOCK_RECORDS) {
+        int ed = min(st + (int)COMPACT_BLOCK_RECORDS, data.size());
+        CompactBlock block;
+        block.offset = offset;
+        block.first_feat = data.offsets[st];
+        blocks.push_back(block);
+        out.clear();
+        for (int i=st; i<ed; i++) {
+            int len = data.len(i);
+            feats.assign(data.row(i), data.row(i) + len);
+            stable_sort(feats.begin(), feats.end(),
+                    [](const Feat &a, const Feat &b) {
+                    return a.id < b.id;
+                    });
+            bool binary = true;
+            for (int k=0; k<len; k++) {
+                binary = binary && feats[k].value == 1.0f;
+            }
+            put_varint(out, data.label(i));
+            put_varint(out, (uint32_t)len << 1 | binary);
+            int last = 0;
+            for (int k=0; k<len; k++) {
+                uint32_t delta = feats[k].id - last;
+                last = feats[k].id;
+                if (binary) {
+                    put_varint(out, delta);
+                    continue;
+                }
+                bool valued = feats[k].value != 1.0f;
+                put_varint(out, delta << 1 | valued);
+                if (valued) {
+                    out.append((const char *)&feats[k].value,
+                            sizeof(float));
+                }
+            }
+        }
+        fo.write(out.data(), out.size());
+        offset += out.size();
+    }
+
+    // where the last block ends
+    CompactBlock sentinel;
+    sentinel.offset = offset;
+    sentinel.first_feat = data.nnz();
+    blocks.push_back(sentinel);
+
+    // the table is read in place, align it
+    char pad[8] = {0};
+    size_t pad_bytes = (8 - offset % 8) % 8;
+    header.table_offset = offset + pad_bytes;
+    fo.write(pad, pad_bytes);
+    fo.write(blocks.data(), sizeof(CompactBlock) * blocks.size());
+    fo.seek(0);
+    fo.write(&header, sizeof(header));
+    if (!fo.commit()) {
+        throw "cannot write compact file";
+    }
+}
+
+CompactFile::CompactFile(const char *filename) : m_file(filename) {
+    size_t length = m_file.size();
+    if (length < sizeof(CompactHeader)) {
+        throw "corrupted compact file";
+    }
+    m_data = (const unsigned char *)m_file.data();
+    m_file.will_need();
+
+    memcpy(&m_header, m_data, sizeof(m_header));
+    uint64_t records = m_header.block_records;
+    m_block_cnt = records == 0 ? 0
+        : (m_header.record_cnt + records - 1) / records;
+    bool ok = memcmp(m_header.magic, COMPACT_MAGIC,
+            sizeof(m_header.magic)) == 0
+        && m_header.version == COMPACT_VERSION && records > 0
+        && m_header.table_offset % 8 == 0
+        && m_header.table_offset >= sizeof(m_header)
+        && m_header.table_offset <= length
+        && (length - m_header.table_offset) / sizeof(CompactBlock)
+        == m_block_cnt + 1
+        && (length - m_header.table_offset) % sizeof(CompactBlock) == 0
+        // every record and feature takes a byte at least
+        && m_header.record_cnt <= length && m_header.nnz <= length;
+    m_blocks = (const CompactBlock *)(m_data + m_header.table_offset);
+    // the blocks follow each other, as do their features, and the
+    // sentinel after the last one holds the ends
+    ok = ok && m_blocks[0].offset == sizeof(m_header)
+        && m_blocks[0].first_feat == 0
+        && m_blocks[m_block_cnt].offset <= m_header.table_offset
+        && m_blocks[m_block_cnt].first_feat == m_header.nnz;
+    for (size_t b=0; ok && b<m_block_cnt; b++) {
+        ok = m_blocks[b].offset <= m_blocks[b + 1].offset
+            && m_blocks[b].first_feat <= m_blocks[b + 1].first_feat;
+    }
+    if (!ok) {
+        throw "corrupted compact file";
+    }
+}
+
+void CompactFile::decode(Dataset &data, int thread_cnt) const {
+    size_t n = size();
+    data.labels.resize(n);
+    data.offsets.resize(n + 1);
+    data.feats.resize(nnz());
+    data.offsets[n] = nnz();
+
+    // each thread decodes a range of blocks
+    thread_cnt = min(thread_cnt, (int)m_block_cnt);
+    parallel_range(m_block_cnt, thread_cnt,
+            [this, &data](size_t st, size_t ed) {
+            for (size_t b=st; b<ed; b++) {
+                decode_block(data, b);
+            }
+            });
+}
+
+void CompactFile::decode_block(Dataset &data, size_t b) const {
+    size_t st = b * m_header.block_records;
+    size_t ed = min(st + m_header.block_records, size());
+    const unsigned char *p = m_data + m_blocks[b].offset;
+    const unsigned char *end = m_data + m_blocks[b + 1].offset;
+    size_t pos = m_blocks[b].first_feat;
+    size_t last = m_blocks[b + 1].first_feat;
+    for (size_t i=st; i<ed; i++) {
+        data.labels[i] = get_varint(p, end);
+        uint32_t head = get_varint(p, end);
+        size_t len = head >> 1;
+        if (len > last - pos) {
+            throw "corrupted compact file";
+        }
+        data.offsets[i] = pos;
+        if (head & 1) {
+            get_binary_feats(p, end, len, data.feats.data() + pos);
+        }
+        else {
+            get_feats(p, end, len, data.feats.data() + pos);
+        }
+        pos += len;
+    }
+    // a block must end where the next one starts
+    if (p != end || pos != last) {
+        throw "corrupted compact file";
+    }
+}
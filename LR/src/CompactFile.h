@@ -0,0 +1,97 @@
+/*
+ * CompactFile.h
+ * The declaration of the compact feature file format
+ */
+
+#ifndef COMPACT_FILE_HEADER
+#define COMPACT_FILE_HEADER
+
+#include "Dataset.h"
+#include "FileIO.h"
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * A compact alternative to the .bin format. The file is
+ *     CompactHeader, blocks of block_records records, CompactBlock table
+ * and each record in a block is
+ *     varint label; varint len << 1 | binary;
+ *     binary: varint delta[len]
+ *     else, len times: varint delta << 1 | valued; float value if valued
+ * with labels and ids 0-based. The ids of a record are sorted and
+ * stored as the difference to the previous id, the first one to 0, in
+ * little endian base 128 varints. A feature whose value is 1 stores no
+ * value. A record of only such features is binary and stores the bare
+ * deltas, any other record marks each feature that stores its float
+ * right after its delta. The block table gives the offset of every
+ * block and the position of its first feature, so blocks decode
+ * independently, followed by a sentinel with the end of the blocks and
+ * the feature count. The table is 8 byte aligned
+ */
+const uint32_t COMPACT_VERSION = 1;
+const uint32_t COMPACT_BLOCK_RECORDS = 4096;
+
+struct CompactHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_records;
+    uint64_t record_cnt;
+    uint64_t nnz;
+    uint64_t table_offset;
+};
+
+struct CompactBlock {
+    uint64_t offset;
+    uint64_t first_feat;
+};
+
+/*
+ * whether filename starts like a compact feature file
+ */
+bool is_compact_file(const char *filename);
+
+/*
+ * Write data in the compact format, sorting the features of every
+ * record by id. Throw if it can not be written
+ */
+void write_compact(const Dataset &data, const char *filename);
+
+/*
+ * A read-only memory mapping of a compact feature file
+ */
+class CompactFile {
+    public:
+        /*
+         * map the file and check its header and block table, throw on
+         * failure
+         */
+        CompactFile(const char *filename);
+
+        size_t size() const {
+            return m_header.record_cnt;
+        }
+        size_t nnz() const {
+            return m_header.nnz;
+        }
+        /*
+         * decode all records into data on thread_cnt threads, each
+         * taking a range of blocks. Throw if a record is corrupted
+         */
+        void decode(Dataset &data, int thread_cnt) const;
+    private:
+        CompactFile(const CompactFile &);
+        CompactFile &operator=(const CompactFile &);
+
+        /*
+         * decode block b into data, whose arrays are already sized
+         */
+        void decode_block(Dataset &data, size_t b) const;
+
+        MappedFile m_file;
+        const unsigned char *m_data;
+        CompactHeader m_header;
+        const CompactBlock *m_blocks;
+        size_t m_block_cnt;
+};
+
+#endif
@@ -13,8 +13,32 @@ std::string replace(std::string s, std::string t) {
     return s;
 }
 
+Config::Config() {
+    class_cnt = 5;
+    affinity = 0;
+    first_cpu = 0;
+    sweep_parallel = 1;
+    folds = 0;
+    simd = "auto";
+    precision = "double";
+    stream = 0;
+    stream_buffer = 256;
+    sample_index = 0;
+    feature_suffix = ".bin";
+    predict_batch = 4096;
+    mode = "train";
+    checkpoint = 0;
+    prune = 0;
+    hash_bits = 0;
+    optimizer = "sgd";
+    l1 = 0;
+    ftrl_beta = 1;
+    server_batch = 64;
+    server_wait = 200;
+}
+
 void Config::parse(const char *cfg_filename) {
-    std::cout << "start parsing config\n";
+    std::clog << "start parsing config\n";
     std::ifstream cfg_file(cfg_filename, std::ios_base::in);
     std::string line;
     while (std::getline(cfg_file, line)) {
@@ -42,18 +66,108 @@ void Config::parse(const char *cfg_filename) {
         else if (key == "momentum") {
             momentum = atof(val.c_str());
         }
+        else if (key == "optimizer") {
+            optimizer = val;
+        }
+        else if (key == "l1") {
+            l1 = atof(val.c_str());
+        }
+        else if (key == "ftrl_beta") {
+            ftrl_beta = atof(val.c_str());
+        }
         else if (key == "batch_size") {
             batch_size = atoi(val.c_str());
         }
         else if (key == "feature_size") {
             feature_size = atoi(val.c_str());
         }
+        else if (key == "hash_bits") {
+            hash_bits = atoi(val.c_str());
+            if (hash_bits < 0 || hash_bits > 30) {
+                throw "hash_bits must be 0 .. 30";
+            }
+        }
+        else if (key == "class_cnt") {
+            class_cnt = atoi(val.c_str());
+        }
         else if (key == "iter_cnt") {
             iter_cnt = atoi(val.c_str());
         }
         else if (key == "thread_cnt") {
             thread_cnt = atoi(val.c_str());
         }
+        else if (key == "affinity") {
+            affinity = atoi(val.c_str());
+        }
+        else if (key == "first_cpu") {
+            first_cpu = atoi(val.c_str());
+        }
+        else if (key == "sweep_alpha") {
+            sweep_alpha = val;
+        }
+        else if (key == "sweep_lambda") {
+            sweep_lambda = val;
+        }
+        else if (key == "sweep_momentum") {
+            sweep_momentum = val;
+        }
+        else if (key == "sweep_batch_size") {
+            sweep_batch_size = val;
+        }
+        else if (key == "sweep_parallel") {
+            sweep_parallel = atoi(val.c_str());
+        }
+        else if (key == "folds") {
+            folds = atoi(val.c_str());
+        }
+        else if (key == "stream") {
+            stream = atoi(val.c_str());
+        }
+        else if (key == "stream_buffer") {
+            stream_buffer = atoi(val.c_str());
+        }
+        else if (key == "feature_suffix") {
+            feature_suffix = val;
+        }
+        else if (key == "sample_index") {
+            sample_index = atoi(val.c_str());
+        }
+        else if (key == "predict_batch") {
+            predict_batch = atoi(val.c_str());
+        }
+        else if (key == "precision") {
+            precision = val;
+        }
+        else if (key == "mode") {
+            mode = val;
+        }
+        else if (key == "model_filename") {
+            model_filename = val;
+        }
+        else if (key == "sparse_model_filename") {
+            sparse_model_filename = val;
+        }
+        else if (key == "prune") {
+            prune = atof(val.c_str());
+        }
+        else if (key == "checkpoint") {
+            checkpoint = atoi(val.c_str());
+        }
+        else if (key == "profile_trace") {
+            profile_trace = val;
+        }
+        else if (key == "server_socket") {
+            server_socket = val;
+        }
+        else if (key == "server_batch") {
+            server_batch = atoi(val.c_str());
+        }
+        else if (key == "server_wait") {
+            server_wait = atoi(val.c_str());
+        }
+        else if (key == "simd") {
+            simd = val;
+        }
         else {
             throw "unseen config key";
         }
@@ -65,6 +179,6 @@ void Config::parse(const char *cfg_filename) {
     output_filename_dev = replace(output_filename_train, "dev");
     output_filename_test = replace(output_filename_train, "test");
 
-    std::cout << "finish parsing config\n";
+    std::clog << "finish parsing config\n";
 }
 
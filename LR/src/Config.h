@@ -23,18 +23,90 @@ class Config {
 
         int dict_top;
         int feature_size;
+        // hash the feature ids into 1 << hash_bits buckets, which then
+        // replace feature_size, 0 to use the ids as they are
+        int hash_bits;
+        // number of classes, labels are 1 .. class_cnt in the files
+        int class_cnt;
         // learning rate
         float alpha;
         // normalization factor
         float lambda;
 
         float momentum;
+        // update rule: sgd (with momentum), adagrad, adam or ftrl
+        std::string optimizer;
+        // L1 strength and beta of ftrl
+        float l1;
+        float ftrl_beta;
         // minibatch size
         int batch_size;
         // maximum iteration count
         int iter_cnt;
         // number of threads in training
         int thread_cnt;
+        // pin each training thread to its own cpu of those the process
+        // may run on, off by default
+        int affinity;
+        // the index among the allowed cpus of the one the first
+        // training thread is pinned to
+        int first_cpu;
+        // read the feature files in chunks instead of loading them
+        int stream;
+        // size of one chunk in MB when streaming
+        int stream_buffer;
+        // appended to feature_filename for the file of each set, .bin
+        // or .lrc for the compact format written in convert mode
+        std::string feature_suffix;
+        // keep the record offsets of each .bin file in a .idx sidecar
+        // so later loads do not walk the file
+        int sample_index;
+        // number of samples scored together by one thread in predict
+        int predict_batch;
+        // scalar type of the model: double, float, or compare to
+        // train both and log their convergence side by side
+        std::string precision;
+        // train a model, score the dev and test sets with the model
+        // saved in model_filename, sweep the sweep_* grid, or convert
+        // the .bin files of the sets to the compact .lrc format
+        std::string mode;
+        // where the model is saved after training, empty for no model
+        std::string model_filename;
+        // iterations between model checkpoints, 0 for none
+        int checkpoint;
+        // where the time of each phase is traced per iteration and
+        // thread, empty for only logging it
+        std::string profile_trace;
+        // where the pruned sparse model is saved, empty for none
+        std::string sparse_model_filename;
+        // feature columns with no weight above prune in magnitude are
+        // left out of the sparse model
+        float prune;
+        // unix socket the scoring server listens on, empty for stdin
+        std::string server_socket;
+        // most requests the scoring server scores together
+        int server_batch;
+        // microseconds the server waits to fill a batch
+        int server_wait;
+        // comma separated values of the hyper parameters to try in
+        // sweep mode, empty for the value of the key itself
+        std::string sweep_alpha;
+        std::string sweep_lambda;
+        std::string sweep_momentum;
+        std::string sweep_batch_size;
+        // models trained at the same time in sweep mode, thread_cnt
+        // is split between them
+        int sweep_parallel;
+        // cross validation folds of the training set in sweep mode,
+        // 0 to score on the dev set instead
+        int folds;
+        // softmax implementation: auto, avx512, avx2 or scalar
+        std::string simd;
+
+        /*
+         * set the default values of optional keys
+         */
+        Config();
 
         /*
          * parse the config file
@@ -0,0 +1,61 @@
+/*
+ * Dataset.cpp
+ * The definition of class Dataset
+ */
+
+#include "Dataset.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+Dataset::Dataset() {
+    offsets.push_back(0);
+}
+
+Dataset::Dataset(const SampleFile &file, int thread_cnt) {
+    size_t n = file.size();
+    // every record is an 8 byte header and its 8 byte features, so
+    // where the features of a record go follows from its offset alone
+    labels.resize(n);
+    offsets.resize(n + 1);
+    feats.resize(file.offset(n) / sizeof(RawFeat) - n);
+    offsets[n] = feats.size();
+
+    // decode contiguous ranges of records in parallel
+    thread_cnt = std::min(thread_cnt, (int)(n / 1024) + 1);
+    parallel_range(n, thread_cnt, [this, &file](size_t st, size_t ed) {
+        for (size_t i=st; i<ed; i++) {
+            SampleView s = file.sample(i);
+            size_t pos = file.offset(i) / sizeof(RawFeat) - i;
+            labels[i] = s.label;
+            offsets[i] = pos;
+            Feat *f = feats.data() + pos;
+            for (int k=0; k<s.len; k++) {
+                f[k].id = s.id(k);
+                f[k].value = s.value(k);
+            }
+        }
+    });
+}
+
+void Dataset::append(const SampleView &s) {
+    labels.push_back(s.label);
+    for (int k=0; k<s.len; k++) {
+        Feat f;
+        f.id = s.id(k);
+        f.value = s.value(k);
+        feats.push_back(f);
+    }
+    offsets.push_back(feats.size());
+}
+
+void Dataset::append(const Dataset &src, int i) {
+    labels.push_back(src.labels[i]);
+    feats.insert(feats.end(), src.row(i), src.row(i) + src.len(i));
+    offsets.push_back(feats.size());
+}
+
+void Dataset::clear() {
+    labels.clear();
+    feats.clear();
+    offsets.assign(1, 0);
+}
@@ -0,0 +1,62 @@
+/*
+ * Dataset.h
+ * The declaration of class Dataset
+ */
+
+#ifndef DATASET_HEADER
+#define DATASET_HEADER
+
+#include "Sample.h"
+#include "SampleFile.h"
+#include <vector>
+#include <cstddef>
+
+/*
+ * A packed CSR store of samples: one labels array, one row offsets
+ * array and one interleaved (id, value) array. Row i owns the features
+ * feats[offsets[i]] .. feats[offsets[i + 1] - 1]
+ */
+class Dataset {
+    public:
+        Dataset();
+        /*
+         * pack all samples of a mapped file, decoding on thread_cnt
+         * threads
+         */
+        Dataset(const SampleFile &file, int thread_cnt = 1);
+
+        int size() const {
+            return labels.size();
+        }
+        size_t nnz() const {
+            return feats.size();
+        }
+        int label(int i) const {
+            return labels[i];
+        }
+        int len(int i) const {
+            return offsets[i + 1] - offsets[i];
+        }
+        const Feat *row(int i) const {
+            return feats.data() + offsets[i];
+        }
+
+        /*
+         * append one sample to the end of the store
+         */
+        void append(const SampleView &s);
+        /*
+         * append sample i of another store
+         */
+        void append(const Dataset &src, int i);
+        /*
+         * remove all samples but keep the memory for reuse
+         */
+        void clear();
+
+        std::vector<int> labels;
+        std::vector<size_t> offsets;
+        std::vector<Feat> feats;
+};
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * FeatureHash.cpp
+ * The definition of the hashing trick for feature ids
+ */
+
+#include "FeatureHash.h"
+#include <vector>
+#include <cstdio>
+#include <cmath>
+
+using namespace std;
+
+void hash_features(Dataset &data, int bits) {
+    for (size_t i=0; i<data.feats.size(); i++) {
+        data.feats[i].id = hash_feature(data.feats[i].id, bits);
+    }
+}
+
+void prepare_features(Dataset &data, int feature_size, int class_cnt,
+        int hash_bits, HashStats *stats) {
+    for (size_t i=0; i<data.labels.size(); i++) {
+        if (data.labels[i] < 0 || data.labels[i] >= class_cnt) {
+            throw "label out of range, raise class_cnt";
+        }
+    }
+    if (hash_bits > 0) {
+        if (stats != NULL) {
+            stats->add(data);
+        }
+        hash_features(data, hash_bits);
+        return;
+    }
+    for (size_t i=0; i<data.feats.size(); i++) {
+        if (data.feats[i].id < 0 || data.feats[i].id >= feature_size) {
+            throw "feature id out of range, raise feature_size or "
+                "set hash_bits";
+        }
+    }
+}
+
+HashStats::HashStats(int bits) {
+    m_bits = bits;
+    m_used.assign((((size_t)1 << bits) + 63) / 64, 0);
+    m_registers.assign(1 << HLL_BITS, 0);
+}
+
+void HashStats::add(const Dataset &data) {
+    for (size_t i=0; i<data.feats.size(); i++) {
+        int id = data.feats[i].id;
+        uint32_t b = hash_feature(id, m_bits);
+        m_used[b / 64] |= 1ULL << (b % 64);
+        // the splitmix64 finalizer, all 64 bits depend on the id
+        uint64_t h = (uint32_t)id;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+        // the register of the top bits keeps the longest run of zeros
+        // seen in the rest
+        uint64_t rest = h << HLL_BITS | 1ULL << (HLL_BITS - 1);
+        uint8_t rank = __builtin_clzll(rest) + 1;
+        uint8_t &r = m_registers[h >> (64 - HLL_BITS)];
+        r = max(r, rank);
+    }
+}
+
+string HashStats::summary() const {
+    size_t buckets = (size_t)1 << m_bits;
+    size_t used = 0;
+    for (uint64_t w : m_used) {
+        used += __builtin_popcountll(w);
+    }
+    double m = m_registers.size();
+    double sum = 0;
+    int zeros = 0;
+    for (uint8_t r : m_registers) {
+        sum += ldexp(1.0, -r);
+        zeros += r == 0;
+    }
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        // linear counting is closer for few ids
+        estimate = m * log(m / zeros);
+    }
+    // every used bucket holds one id at least
+    size_t ids = max((size_t)llround(estimate), used);
+    // the collisions uniformly random buckets would give
+    double expected = ids - buckets * (1 - pow(1 - 1.0 / buckets, ids));
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%zu buckets, ~%zu distinct ids, "
+            "%zu buckets used, ~%zu ids collide (%.1f expected)",
+            buckets, ids, used, ids - used, expected);
+    return buf;
+}
@@ -0,0 +1,68 @@
+/*
+ * FeatureHash.h
+ * The declaration of the hashing trick for feature ids
+ */
+
+#ifndef FEATURE_HASH_HEADER
+#define FEATURE_HASH_HEADER
+
+#include "Dataset.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * the bucket of a 0-based feature id among 1 << bits buckets,
+ * bits is 1 .. 31. Fibonacci hashing: the top bits of the product
+ * depend on all bits of the id
+ */
+inline int hash_feature(int id, int bits) {
+    return (uint32_t)id * 2654435769u >> (32 - bits);
+}
+
+/*
+ * replace every feature id of data by its bucket
+ */
+void hash_features(Dataset &data, int bits);
+
+class HashStats;
+
+/*
+ * get freshly read samples ready for a model of feature_size columns
+ * and class_cnt classes: check the labels are below class_cnt, map the
+ * feature ids to their buckets when hash_bits is set, collecting the
+ * raw ids into stats unless it is NULL, otherwise check the ids fit in
+ * feature_size. throw on a label or id out of range
+ */
+void prepare_features(Dataset &data, int feature_size, int class_cnt,
+        int hash_bits, HashStats *stats);
+
+/*
+ * Summarizes how the raw feature ids seen before hashing share the
+ * buckets, in memory bounded whatever the vocabulary: a bitmap of the
+ * used buckets, and a HyperLogLog sketch that estimates the distinct
+ * ids within about 1%
+ */
+class HashStats {
+    public:
+        HashStats(int bits);
+
+        /*
+         * record the raw feature ids of data, call before hashing it
+         */
+        void add(const Dataset &data);
+        /*
+         * the estimated number of distinct ids, the used buckets and
+         * the ids that share a bucket with another id
+         */
+        std::string summary() const;
+    private:
+        // the sketch has 1 << HLL_BITS registers
+        static const int HLL_BITS = 14;
+
+        int m_bits;
+        std::vector<uint64_t> m_used;
+        std::vector<uint8_t> m_registers;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * FileIO.cpp
+ * The definition of class MappedFile and class AtomicFile
+ */
+
+#include "FileIO.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+MappedFile::MappedFile(const char *filename) {
+    m_data = NULL;
+    m_length = 0;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        throw "cannot open file";
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        ::close(fd);
+        throw "cannot stat file";
+    }
+    m_length = st.st_size;
+    m_mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    if (m_length > 0) {
+        void *p = mmap(NULL, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            throw "cannot map file";
+        }
+        m_data = (char *)p;
+    }
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data != NULL) {
+        munmap(m_data, m_length);
+    }
+}
+
+void MappedFile::will_need() const {
+    if (m_data != NULL) {
+        madvise(m_data, m_length, MADV_WILLNEED);
+    }
+}
+
+AtomicFile::AtomicFile() {
+    m_file = NULL;
+    m_ok = false;
+}
+
+AtomicFile::~AtomicFile() {
+    discard();
+}
+
+bool AtomicFile::open(const char *filename) {
+    discard();
+    m_filename = filename;
+    m_tmp = m_filename + ".tmp";
+    m_file = fopen(m_tmp.c_str(), "wb");
+    m_ok = m_file != NULL;
+    return m_ok;
+}
+
+bool AtomicFile::write(const void *p, size_t bytes) {
+    m_ok = m_ok && (bytes == 0 || fwrite(p, bytes, 1, m_file) == 1);
+    return m_ok;
+}
+
+bool AtomicFile::seek(long offset) {
+    m_ok = m_ok && fseek(m_file, offset, SEEK_SET) == 0;
+    return m_ok;
+}
+
+bool AtomicFile::commit() {
+    if (m_file == NULL) {
+        return false;
+    }
+    bool ok = fclose(m_file) == 0 && m_ok;
+    m_file = NULL;
+    if (!ok || rename(m_tmp.c_str(), m_filename.c_str()) != 0) {
+        remove(m_tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+void AtomicFile::discard() {
+    if (m_file != NULL) {
+        fclose(m_file);
+        m_file = NULL;
+        remove(m_tmp.c_str());
+    }
+    m_ok = false;
+}
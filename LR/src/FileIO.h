@@ -0,0 +1,93 @@
+/*
+ * FileIO.h
+ * The declaration of the file helpers shared by the sample, compact
+ * and model file formats
+ */
+
+#ifndef FILE_IO_HEADER
+#define FILE_IO_HEADER
+
+#include <cstdio>
+#include <cstddef>
+#include <string>
+
+/*
+ * A read-only memory mapping of a whole file, unmapped when destroyed.
+ * An empty file has no mapping and data() is NULL
+ */
+class MappedFile {
+    public:
+        /*
+         * map the file, throw on failure
+         */
+        MappedFile(const char *filename);
+        ~MappedFile();
+
+        const char *data() const {
+            return m_data;
+        }
+        size_t size() const {
+            return m_length;
+        }
+        /*
+         * the modification time of the file in nanoseconds
+         */
+        long long mtime() const {
+            return m_mtime;
+        }
+        /*
+         * hint that the whole file is about to be read
+         */
+        void will_need() const;
+    private:
+        MappedFile(const MappedFile &);
+        MappedFile &operator=(const MappedFile &);
+
+        char *m_data;
+        size_t m_length;
+        long long m_mtime;
+};
+
+/*
+ * A file written through filename.tmp and renamed over filename by
+ * commit, so readers never see it half written. The temporary file is
+ * removed if commit is not reached or fails
+ */
+class AtomicFile {
+    public:
+        AtomicFile();
+        ~AtomicFile();
+
+        /*
+         * create the temporary file, false if it can not be created
+         */
+        bool open(const char *filename);
+        /*
+         * write bytes at the position, false once any write failed
+         */
+        bool write(const void *p, size_t bytes);
+        /*
+         * move the write position to offset from the start
+         */
+        bool seek(long offset);
+        /*
+         * close the temporary file and rename it over filename, false
+         * and nothing left behind if any step failed
+         */
+        bool commit();
+    private:
+        AtomicFile(const AtomicFile &);
+        AtomicFile &operator=(const AtomicFile &);
+
+        /*
+         * close and remove the temporary file
+         */
+        void discard();
+
+        std::string m_filename;
+        std::string m_tmp;
+        FILE *m_file;
+        bool m_ok;
+};
+
+#endif
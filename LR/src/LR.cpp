@@ -5,9 +5,14 @@
 
 #include "LR.h"
 #include "Utils.h"
-#include <thread>
 #include "Stopwatch.h"
 #include "Log.h"
+#include "Atomic.h"
+#include "Softmax.h"
+#include "SampleStream.h"
+#include "FeatureHash.h"
+#include <cstdint>
+#include <string>
 
 using namespace std;
 
@@ -15,81 +20,388 @@ inline double sqr(double x) {
     return x * x;
 }
 
-LR::LR(Config cfg) {
+/*
+ * the class count of a kernel specialized on K, K = 0 is dynamic
+ */
+template <int K>
+inline int classes(int dynamic) {
+    return K > 0 ? K : dynamic;
+}
+
+/*
+ * ask for the cache lines of bytes at p ahead of their use
+ */
+inline void prefetch(const void *p, size_t bytes) {
+    uintptr_t st = (uintptr_t)p & ~(uintptr_t)(CACHE_LINE_SIZE - 1);
+    uintptr_t ed = (uintptr_t)p + bytes;
+    for (uintptr_t c=st; c<ed; c+=CACHE_LINE_SIZE) {
+        __builtin_prefetch((const void *)c);
+    }
+}
+
+template <typename Real>
+LR<Real>::LR(Config cfg) {
     LOG("start initialize LR\n");
     m_alpha = cfg.alpha;
     m_batch_size = cfg.batch_size;
     m_lambda = cfg.lambda;
     m_feature_size = cfg.feature_size;
-    m_output_size = 5;
+    m_hash_bits = cfg.hash_bits;
+    if (m_hash_bits > 0) {
+        // the columns of w are the buckets, whatever the raw ids are
+        m_feature_size = 1 << m_hash_bits;
+        LOG("feature hashing: %d buckets\n", m_feature_size);
+    }
+    m_output_size = cfg.class_cnt;
     m_iter_cnt = cfg.iter_cnt;
     m_thread_cnt = cfg.thread_cnt;
+    m_predict_batch = cfg.predict_batch;
     m_momentum = cfg.momentum;
+    m_optimizer = parse_optimizer(cfg.optimizer);
+    m_l1 = cfg.l1;
+    m_ftrl_beta = cfg.ftrl_beta;
+    m_stream = cfg.stream;
+    m_stream_buffer = (size_t)cfg.stream_buffer << 20;
+    m_sample_index = cfg.sample_index;
+    m_data = NULL;
+    m_rows = NULL;
+    m_model = NULL;
+    m_model_filename = cfg.model_filename;
+    m_checkpoint = cfg.checkpoint;
+    m_sparse_model_filename = cfg.sparse_model_filename;
+    m_prune = cfg.prune;
+
+    LOG("softmax: %s\n", softmax_selected());
+    switch (m_output_size) {
+        case 2:
+            set_kernels<2>();
+            break;
+        case 5:
+            set_kernels<5>();
+            break;
+        case 10:
+            set_kernels<10>();
+            break;
+        default:
+            LOG("no kernel specialized on %d classes\n", m_output_size);
+            set_kernels<0>();
+            break;
+    }
 
     l.resize(m_thread_cnt);
+    m_busy.resize(m_thread_cnt);
+    m_pool = NULL;
+    m_affinity = cfg.affinity;
+    m_first_cpu = cfg.first_cpu;
+    // the slot after the training threads is the calling thread
+    m_profiler = new Profiler(m_thread_cnt + 1, cfg.profile_trace);
     for (int i=0; i<m_thread_cnt; i++) {
-        dw.push_back(new DenseMat(m_output_size, m_feature_size));
-        dw[i]->setZero();
+        m_ws.push_back(new Workspace<Real>(m_output_size, m_batch_size));
     }
 
-    w = new DenseMat(m_output_size, m_feature_size);
+    LOG("optimizer: %s\n", cfg.optimizer.c_str());
+    // w and the optimizer state wait for training, a model loaded only
+    // for scoring is used in place and needs neither
+    w = NULL;
+    m_weight = NULL;
+    m_step = 0;
+    LOG("finish initialize LR\n");
+}
+
+template <typename Real>
+template <int K>
+void LR<Real>::set_kernels() {
+    m_train_mini_batch = &LR::template train_mini_batch<K>;
+    m_flush = &LR::template flush<K>;
+    switch (m_optimizer) {
+        case OPT_SGD:
+            m_update = &LR::template update<K, OPT_SGD>;
+            break;
+        case OPT_ADAGRAD:
+            m_update = &LR::template update<K, OPT_ADAGRAD>;
+            break;
+        case OPT_ADAM:
+            m_update = &LR::template update<K, OPT_ADAM>;
+            break;
+        case OPT_FTRL:
+            m_update = &LR::template update<K, OPT_FTRL>;
+            break;
+    }
+    m_predict_block = &LR::template predict_block<K>;
+}
+
+template <typename Real>
+LR<Real>::~LR() {
+    delete m_pool;
+    for (int i=0; i<m_thread_cnt; i++) {
+        delete m_ws[i];
+    }
+    delete w;
+    delete m_model;
+    delete m_profiler;
+}
+
+template <typename Real>
+void LR<Real>::save(const char *filename) {
+    LOG("save model to %s\n", filename);
+    save_model(filename, m_feature_size, m_output_size, sizeof(Real),
+            m_hash_bits, w->data());
+}
+
+template <typename Real>
+void LR<Real>::load(const char *filename) {
+    LOG("load model from %s\n", filename);
+    ModelFile *model = new ModelFile(filename);
+    if (model->feature_size() != m_feature_size
+            || model->class_cnt() != m_output_size) {
+        delete model;
+        throw "model shape does not match the config";
+    }
+    if (model->hash_bits() != m_hash_bits) {
+        delete model;
+        throw "model feature hashing does not match the config";
+    }
+    if (model->scalar_size() != (int)sizeof(Real)) {
+        delete model;
+        throw "model scalar type does not match the precision";
+    }
+    delete m_model;
+    m_model = model;
+    m_weight = (const Real *)m_model->weight();
+    if (m_model->sparse()) {
+        LOG("sparse model: %d of %d feature columns\n",
+                m_model->column_cnt(), m_feature_size);
+    }
+}
+
+template <typename Real>
+void LR<Real>::save_sparse(const char *filename, double threshold) {
+    const Real *pw = w->data();
+    vector<int> ids;
+    vector<Real> packed;
+    for (int j=0; j<m_feature_size; j++) {
+        const Real *wj = pw + (size_t)j * m_output_size;
+        bool keep = false;
+        for (int c=0; c<m_output_size; c++) {
+            keep = keep || fabs(wj[c]) > threshold;
+        }
+        if (keep) {
+            ids.push_back(j);
+            packed.insert(packed.end(), wj, wj + m_output_size);
+        }
+    }
+    LOG("save sparse model to %s, %zu of %d feature columns, %.1f KB\n",
+            filename, ids.size(), m_feature_size,
+            (sizeof(Real) * packed.size() + sizeof(int) * 3 * ids.size())
+            / 1024.0);
+    save_sparse_model(filename, m_feature_size, m_output_size, sizeof(Real),
+            m_hash_bits, ids, packed.data());
+}
+
+template <typename Real>
+void LR<Real>::save_trained() {
+    if (!m_model_filename.empty()) {
+        save(m_model_filename.c_str());
+    }
+    if (!m_sparse_model_filename.empty()) {
+        save_sparse(m_sparse_model_filename.c_str(), m_prune);
+    }
+}
+
+template <typename Real>
+void LR<Real>::init_weights() {
+    if (w != NULL) {
+        return;
+    }
+    w = new DenseMatT<Real>(m_output_size, m_feature_size);
     // random initialize
     for (int i=0; i<m_output_size; i++) {
         for (int j=0; j<m_feature_size; j++) {
-            (*w)(i, j) = (random() % 1000) / 10000.0;
+            (*w)(i, j) = (random() % 1000) / (Real)10000.0;
         }
     }
-    LOG("finish initialize LR\n");
+    if (m_optimizer == OPT_FTRL) {
+        // the weights of FTRL follow from its state, which starts at 0
+        w->setZero();
+    }
+    m_weight = w->data();
+
+    m_state.assign((size_t)optimizer_slots(m_optimizer) * m_output_size
+            * m_feature_size, 0);
+    if (m_optimizer == OPT_SGD) {
+        m_last.assign(m_feature_size, 0);
+    }
 }
 
-void LR::train(const char *train_filename, const char *out_filename) {
+template <typename Real>
+void LR<Real>::warm_start() {
+    init_weights();
+    if (m_model == NULL) {
+        return;
+    }
+    if (m_model->sparse()) {
+        // the pruned columns start from 0
+        w->setZero();
+        for (int i=0; i<m_model->column_cnt(); i++) {
+            copy(m_weight + (size_t)i * m_output_size,
+                    m_weight + (size_t)(i + 1) * m_output_size,
+                    w->data() + (size_t)m_model->ids()[i] * m_output_size);
+        }
+    }
+    else {
+        copy(m_weight, m_weight + (size_t)m_output_size * m_feature_size,
+                w->data());
+    }
+    delete m_model;
+    m_model = NULL;
+    m_weight = w->data();
+}
+
+template <typename Real>
+void LR<Real>::checkpoint(int iter) {
+    if (m_checkpoint > 0 && !m_model_filename.empty()
+            && (iter + 1) % m_checkpoint == 0) {
+        save(m_model_filename.c_str());
+    }
+}
+
+template <typename Real>
+void LR<Real>::train(const char *train_filename, const char *out_filename) {
+    warm_start();
+    if (m_stream) {
+        train_stream(train_filename, out_filename);
+        return;
+    }
     //LOG("start LR train\n");
-    m_samples = read_sample(train_filename);
-    int n = m_samples.size();
-    m_idx.resize(n);
-    for (int i=0; i<n; i++) {
-        m_idx[i] = i;
+    m_profiler->start(m_thread_cnt);
+    m_data = read_sample(train_filename, m_thread_cnt, m_sample_index);
+    HashStats stats(m_hash_bits);
+    prepare(*m_data, &stats);
+    m_profiler->lap(m_thread_cnt, PHASE_LOAD);
+    if (m_hash_bits > 0) {
+        LOG("hash: %s\n", stats.summary().c_str());
     }
+    int n = m_data->size();
+
+    train_epochs();
+
+    LOG("finish train\n");
+    save_trained();
+
+    LOG("start calculate error\n");
+    // calculate error while writing the result
+    double acc;
+    double rmse;
+    print_result(out_filename, acc, rmse);
+    LOG("acc: %.5f, rmse: %.5f\n", acc / n, sqrt(rmse / n));
 
+    // free memory
+    delete m_data;
+    m_data = NULL;
+    LOG("finish LR train\n");
+}
+
+template <typename Real>
+void LR<Real>::fit(const Dataset &data, const vector<int> *rows) {
+    warm_start();
+    // the kernels only read the samples
+    m_data = const_cast<Dataset *>(&data);
+    m_rows = rows;
+    train_epochs();
+    m_data = NULL;
+    m_rows = NULL;
+}
+
+template <typename Real>
+void LR<Real>::evaluate(const Dataset &data, double &acc, double &rmse) {
+    m_data = const_cast<Dataset *>(&data);
+    predict(NULL, acc, rmse);
+    m_data = NULL;
+    int n = data.size();
+    acc /= n;
+    rmse = sqrt(rmse / n);
+}
+
+template <typename Real>
+void LR<Real>::train_epochs() {
+    int n = m_rows != NULL ? m_rows->size() : m_data->size();
     float last_loss = 0;
 
     Stopwatch stopwatch;
     // one iteration is train through the whole dataset
     for (int iter=0; iter<m_iter_cnt; iter++) {
-        random_permutation(m_idx); 
-        // hogwild! training
-        vector<thread> pool;
-        for (int i=0; i<m_thread_cnt; i++) {
-            pool.push_back(thread(
-                        [=]() {
-                        train_thread(i);
-                        }));
-        }
-        for (int i=0; i<m_thread_cnt; i++) {
-            pool[i].join();
+        double epoch_start = wall_time();
+        reset_stats();
+        double loss = run_epoch();
+        string busy = busy_summary(wall_time() - epoch_start);
+        loss /= n;
+        m_history.push_back(loss);
+        if ((iter + 1) % 1 == 0) {
+            LOG("iter: %d, l: %.10f, time: %.2fs, busy/idle:%s\n",
+                    iter + 1, loss, stopwatch.time(), busy.c_str());
+            LOG("phase wall max/cpu sum:%s\n",
+                    m_profiler->report(iter + 1).c_str());
+        }
+        if ((iter + 1) % 10 == 0) {
+            // the error of the forward passes of this iteration, no
+            // extra pass over the data
+            double acc;
+            double rmse;
+            train_error(acc, rmse);
+            LOG("acc: %.10f, rmse: %.10f\n", acc / n, sqrt(rmse / n));
         }
+        checkpoint(iter);
+
+        if (fabs(loss - last_loss) < 1e-7) {
+            break;
+        }
+    }
+}
+
+template <typename Real>
+void LR<Real>::train_stream(const char *train_filename,
+        const char *out_filename) {
+    LOG("start LR stream train\n");
+    SampleStream stream(train_filename, m_stream_buffer);
+
+    float last_loss = 0;
+    HashStats stats(m_hash_bits);
+
+    Stopwatch stopwatch;
+    // one iteration is one pass over the file, chunk by chunk
+    for (int iter=0; iter<m_iter_cnt; iter++) {
+        double epoch_start = wall_time();
+        reset_stats();
         double loss = 0;
-        for (int i=0; i<m_thread_cnt; i++) {
-            loss += l[i];
+        long long n = 0;
+        m_profiler->start(m_thread_cnt);
+        while ((m_data = stream.next()) != NULL) {
+            // the ids are collected for the stats in the first pass
+            prepare(*m_data, iter == 0 ? &stats : NULL);
+            m_profiler->lap(m_thread_cnt, PHASE_LOAD);
+            loss += run_epoch();
+            n += m_data->size();
+            stream.release(m_data);
+            m_profiler->start(m_thread_cnt);
         }
-        loss /= n;
-        if ((iter + 1) % 1 == 0) {
-            LOG("iter: %d, l: %.10f, time: %.2fs\n", iter + 1, loss, stopwatch.time());
+        m_data = NULL;
+        if (iter == 0 && m_hash_bits > 0) {
+            LOG("hash: %s\n", stats.summary().c_str());
         }
+        string busy = busy_summary(wall_time() - epoch_start);
+        loss /= n;
+        m_history.push_back(loss);
+        LOG("iter: %d, l: %.10f, time: %.2fs, busy/idle:%s\n",
+                iter + 1, loss, stopwatch.time(), busy.c_str());
+        LOG("phase wall max/cpu sum:%s\n",
+                m_profiler->report(iter + 1).c_str());
         if ((iter + 1) % 10 == 0) {
-            LOG("start calculate error\n");
-            // calculate error
-            vector<pair<int, double>> pred = predict();
-            double acc = 0;
-            double rmse = 0;
-            for (int i=0; i<n; i++) {
-                if (pred[i].first == m_samples[i]->label) {
-                    acc++;
-                }
-                rmse += sqr(pred[i].first - m_samples[i]->label);
-            }
+            double acc;
+            double rmse;
+            train_error(acc, rmse);
             LOG("acc: %.10f, rmse: %.10f\n", acc / n, sqrt(rmse / n));
         }
+        checkpoint(iter);
 
         if (fabs(loss - last_loss) < 1e-7) {
             break;
@@ -97,132 +409,579 @@ void LR::train(const char *train_filename, const char *out_filename) {
     }
 
     LOG("finish train\n");
+    save_trained();
 
     LOG("start calculate error\n");
-    // calculate error
-    vector<pair<int, double>> pred = predict();
     double acc = 0;
     double rmse = 0;
-    for (int i=0; i<n; i++) {
-        if (pred[i].first == m_samples[i]->label) {
-            acc++;
-        }
-        rmse += sqr(pred[i].first - m_samples[i]->label);
+    long long n = 0;
+    FILE *fo = fopen(out_filename, "w");
+    m_profiler->start(m_thread_cnt);
+    while ((m_data = stream.next()) != NULL) {
+        double chunk_acc;
+        double chunk_rmse;
+        prepare(*m_data, NULL);
+        m_profiler->lap(m_thread_cnt, PHASE_LOAD);
+        predict(fo, chunk_acc, chunk_rmse);
+        acc += chunk_acc;
+        rmse += chunk_rmse;
+        n += m_data->size();
+        stream.release(m_data);
+        m_profiler->start(m_thread_cnt);
     }
+    m_data = NULL;
+    fclose(fo);
     LOG("acc: %.5f, rmse: %.5f\n", acc / n, sqrt(rmse / n));
+    LOG("finish LR stream train\n");
+}
 
-    print_result(out_filename);
+template <typename Real>
+void LR<Real>::prepare(Dataset &data, HashStats *stats) {
+    prepare_features(data, m_feature_size, m_output_size, m_hash_bits,
+            stats);
+}
 
-    // free memory
-    for (auto i : m_samples) {
-        delete i;
+template <typename Real>
+ThreadPool *LR<Real>::pool() {
+    if (m_pool == NULL) {
+        m_pool = new ThreadPool(m_thread_cnt, m_affinity, m_first_cpu);
     }
-    LOG("finish LR train\n");
+    return m_pool;
 }
 
-void LR::train_thread(int thread_id) {
-    int t = (m_samples.size() + m_thread_cnt - 1) / m_thread_cnt;
-    int st = t * thread_id;
-    int ed = min(t * (thread_id + 1), (int)m_samples.size());
-    l[thread_id] = 0;
-    for (int i=st; i<ed; i+=m_batch_size) {
-        l[thread_id] += train_mini_batch(i, thread_id);
+template <typename Real>
+double LR<Real>::run_epoch() {
+    m_profiler->start(m_thread_cnt);
+    if (m_rows != NULL) {
+        m_idx = *m_rows;
+    }
+    else {
+        m_idx.resize(m_data->size());
+        for (int i=0; i<(int)m_idx.size(); i++) {
+            m_idx[i] = i;
+        }
+    }
+    int n = m_idx.size();
+    random_permutation(m_idx);
+    if ((int)m_decay.size() < 4 * ((n + m_batch_size - 1) / m_batch_size + 2)) {
+        build_decay((n + m_batch_size - 1) / m_batch_size + 1);
     }
+    m_profiler->lap(m_thread_cnt, PHASE_SHUFFLE);
+
+    // hogwild! training
+    m_cursor = 0;
+    pool()->run([this](int thread_id) {
+            train_thread(thread_id);
+            });
+    if (m_optimizer == OPT_SGD) {
+        m_profiler->start(m_thread_cnt);
+        (this->*m_flush)();
+        m_profiler->lap(m_thread_cnt, PHASE_UPDATE);
+    }
+    double loss = 0;
+    for (int i=0; i<m_thread_cnt; i++) {
+        loss += l[i].v;
+    }
+    return loss;
 }
 
-void LR::test(const char *test_filename, const char *out_filename) {
-    LOG("start test\n");
-    m_samples = read_sample(test_filename);
+template <typename Real>
+void LR<Real>::reset_stats() {
+    for (int i=0; i<m_thread_cnt; i++) {
+        m_busy[i].v = 0;
+        m_ws[i]->correct = 0;
+        m_ws[i]->sq_err = 0;
+    }
+}
 
-    print_result(out_filename);
+template <typename Real>
+void LR<Real>::train_error(double &acc, double &se) {
+    acc = 0;
+    se = 0;
+    for (int i=0; i<m_thread_cnt; i++) {
+        acc += m_ws[i]->correct;
+        se += m_ws[i]->sq_err;
+    }
+}
 
-    for (auto i : m_samples) {
-        delete i;
+template <typename Real>
+string LR<Real>::busy_summary(double epoch_time) {
+    string busy;
+    for (int i=0; i<m_thread_cnt; i++) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), " %.3f/%.3f", m_busy[i].v,
+                max(epoch_time - m_busy[i].v, 0.0));
+        busy += buf;
     }
-    LOG("finish test\n");
+    return busy;
 }
 
-void LR::print_result(const char *out_filename) {
-    vector<pair<int, double>> pred = predict();
+template <typename Real>
+void LR<Real>::train_thread(int thread_id) {
+    double start = wall_time();
+    m_profiler->start(thread_id);
+    int n = m_idx.size();
+    double loss = 0;
+    // take the next batch from the shared cursor, so a thread that got
+    // long samples does not hold up the others. The batch after the
+    // current one is claimed early so it can be prefetched
+    int st = m_cursor.fetch_add(m_batch_size, memory_order_relaxed);
+    while (st < n) {
+        int next = m_cursor.fetch_add(m_batch_size, memory_order_relaxed);
+        gather(st, min(st + m_batch_size, n), thread_id);
+        m_profiler->lap(thread_id, PHASE_GATHER);
+        loss += (this->*m_train_mini_batch)(min(next, n), thread_id);
+        st = next;
+    }
+    l[thread_id].v = loss;
+    m_busy[thread_id].v += wall_time() - start;
+}
+
+template <typename Real>
+void LR<Real>::gather(int st, int ed, int thread_id) {
+    Dataset &batch = m_ws[thread_id]->batch;
+    batch.clear();
+    for (int i=st; i<ed; i++) {
+        batch.append(*m_data, m_idx[i]);
+    }
+}
 
+template <typename Real>
+void LR<Real>::test(const char *test_filename, const char *out_filename) {
+    LOG("start test\n");
+    if (m_stream) {
+        SampleStream stream(test_filename, m_stream_buffer);
+        FILE *fo = fopen(out_filename, "w");
+        m_profiler->start(m_thread_cnt);
+        while ((m_data = stream.next()) != NULL) {
+            double acc;
+            double rmse;
+            prepare(*m_data, NULL);
+            m_profiler->lap(m_thread_cnt, PHASE_LOAD);
+            predict(fo, acc, rmse);
+            stream.release(m_data);
+            m_profiler->start(m_thread_cnt);
+        }
+        m_data = NULL;
+        fclose(fo);
+        LOG("finish test\n");
+        return;
+    }
+    m_profiler->start(m_thread_cnt);
+    m_data = read_sample(test_filename, m_thread_cnt, m_sample_index);
+    prepare(*m_data, NULL);
+    m_profiler->lap(m_thread_cnt, PHASE_LOAD);
+
+    double acc;
+    double rmse;
+    print_result(out_filename, acc, rmse);
+
+    delete m_data;
+    m_data = NULL;
+    LOG("finish test\n");
+}
+
+template <typename Real>
+void LR<Real>::print_result(const char *out_filename, double &acc,
+        double &se) {
     FILE *fo = fopen(out_filename, "w");
-    for (auto p : pred) {
-        fprintf(fo, "%d %.8f\n", p.first + 1, p.second + 1);
+    if (fo == NULL) {
+        throw "cannot open output file";
     }
+    predict(fo, acc, se);
     fclose(fo);
 }
 
-vector<pair<int, double>> LR::predict() {
+template <typename Real>
+void LR<Real>::predict(FILE *fo, double &acc, double &se) {
     LOG("start predict\n");
-    SparseMat *x = create_sparse_matrix(m_feature_size, 
-            m_samples.size(), m_samples);
-    DenseMat *y = forward(x);
-    vector<pair<int, double>> pred;
-    int n = m_samples.size();
+    if (m_weight == NULL) {
+        // neither trained nor loaded, score with the initial weights
+        init_weights();
+    }
+    int n = m_data->size();
+    int blocks = (n + m_predict_batch - 1) / m_predict_batch;
+    // the blocks scored before their text is written out, enough to
+    // keep every thread busy while bounding the buffered text
+    int wave = m_thread_cnt * 4;
+    if (fo != NULL && (int)m_text.size() < wave) {
+        m_text.resize(wave);
+    }
+    for (int i=0; i<m_thread_cnt; i++) {
+        m_ws[i]->correct = 0;
+        m_ws[i]->sq_err = 0;
+    }
+
+    for (int first=0; first<blocks; first+=wave) {
+        int last = min(first + wave, blocks);
+        m_cursor.store(first, memory_order_relaxed);
+        pool()->run([this, first, last, fo](int thread_id) {
+            predict_thread(thread_id, first, last, fo != NULL);
+        });
+        if (fo != NULL) {
+            m_profiler->start(m_thread_cnt);
+            for (int b=first; b<last; b++) {
+                const string &text = m_text[b - first];
+                fwrite(text.data(), 1, text.size(), fo);
+            }
+            m_profiler->lap(m_thread_cnt, PHASE_EVAL);
+        }
+    }
+
+    acc = 0;
+    se = 0;
+    for (int i=0; i<m_thread_cnt; i++) {
+        acc += m_ws[i]->correct;
+        se += m_ws[i]->sq_err;
+    }
+    // reported as iteration 0, the time is not part of an epoch
+    LOG("phase wall max/cpu sum:%s\n", m_profiler->report(0).c_str());
+    LOG("finish predict\n");
+}
+
+template <typename Real>
+void LR<Real>::score(Dataset &data, vector<pair<int, double>> &pred) {
+    if (m_weight == NULL) {
+        init_weights();
+    }
+    prepare(data, NULL);
+    Workspace<Real> &ws = *m_ws[0];
+    int n = data.size();
+    if (ws.scores.size() < (size_t)m_output_size * n) {
+        ws.scores.resize((size_t)m_output_size * n);
+    }
+    pred.resize(n);
+    // the kernels read the samples from m_data
+    Dataset *saved = m_data;
+    m_data = &data;
+    (this->*m_predict_block)(0, n, ws.scores.data(), pred.data());
+    m_data = saved;
+}
+
+template <typename Real>
+void LR<Real>::predict_thread(int thread_id, int first, int last,
+        bool text) {
+    Workspace<Real> &ws = *m_ws[thread_id];
+    int n = m_data->size();
+    // score() may have grown scores alone, size the two on their own
+    if (ws.scores.size() < (size_t)m_output_size * m_predict_batch) {
+        ws.scores.resize((size_t)m_output_size * m_predict_batch);
+    }
+    if (ws.pred.size() < (size_t)m_predict_batch) {
+        ws.pred.resize(m_predict_batch);
+    }
+    m_profiler->start(thread_id);
+    int b;
+    while ((b = m_cursor.fetch_add(1, memory_order_relaxed)) < last) {
+        int st = b * m_predict_batch;
+        int ed = min(st + m_predict_batch, n);
+        (this->*m_predict_block)(st, ed, ws.scores.data(), ws.pred.data());
+        for (int i=st; i<ed; i++) {
+            const pair<int, double> &p = ws.pred[i - st];
+            if (p.first == m_data->label(i)) {
+                ws.correct++;
+            }
+            ws.sq_err += sqr(p.first - m_data->label(i));
+        }
+        if (text) {
+            // format here so the writer only copies bytes
+            string &out = m_text[b - first];
+            out.clear();
+            char line[64];
+            for (int i=0; i<ed-st; i++) {
+                int len = snprintf(line, sizeof(line), "%d %.8f\n",
+                        ws.pred[i].first + 1, ws.pred[i].second + 1);
+                out.append(line, len);
+            }
+        }
+        m_profiler->lap(thread_id, PHASE_EVAL);
+    }
+}
+
+template <typename Real>
+template <int K>
+void LR<Real>::predict_block(int st, int ed, Real *y,
+        pair<int, double> *pred) {
+    const int k_cnt = classes<K>(m_output_size);
+    int n = ed - st;
+    if (m_model != NULL && m_model->sparse()) {
+        forward<K, true>(st, ed, y);
+    }
+    else {
+        forward<K, false>(st, ed, y);
+    }
     for (int i=0; i<n; i++) {
         double E = 0;
         double maxv = 0;
         int maxy = 0;
-        for (int j=0; j<m_output_size; j++) {
-            double v = (*y)(j, i);
+        for (int j=0; j<k_cnt; j++) {
+            double v = y[(size_t)j * n + i];
             E += j * v;
             if (v > maxv) {
                 maxv = v;
                 maxy = j;
             }
         }
-        pred.push_back(make_pair(maxy, E));
+        pred[i] = make_pair(maxy, E);
     }
-
-    delete x;
-    delete y;
-
-    LOG("finish predict\n");
-    return pred;
 }
 
-DenseMat *LR::forward(SparseMat *x) {
-    DenseMat *y = new DenseMat(*w * *x);
-    for (int j=0; j<y->cols(); j++) {
-        double v = 0;
-        for (int i=0; i<m_output_size; i++) {
-            (*y)(i, j) = exp((*y)(i, j));
-            v += (*y)(i, j);
-        }
-        for (int i=0; i<m_output_size; i++) {
-            (*y)(i, j) /= v;
+template <typename Real>
+template <int K, bool SPARSE>
+void LR<Real>::forward(int st, int ed, Real *y) {
+    const int k_cnt = classes<K>(m_output_size);
+    int n = ed - st;
+    const Real *pw = m_weight;
+    fill(y, y + (size_t)k_cnt * n, (Real)0);
+    for (int i=st; i<ed; i++) {
+        const Feat *f = m_data->row(i);
+        int len = m_data->len(i);
+        for (int k=0; k<len; k++) {
+            int col = f[k].id;
+            if (SPARSE) {
+                // a pruned feature contributes nothing
+                col = m_model->find(col);
+                if (col < 0) {
+                    continue;
+                }
+            }
+            const Real *wj = pw + (size_t)col * k_cnt;
+            for (int c=0; c<k_cnt; c++) {
+                y[(size_t)c * n + i - st] += wj[c] * f[k].value;
+            }
         }
     }
-    return y;
+    softmax(y, k_cnt, n, n, NULL);
+}
+
+template <typename Real>
+void LR<Real>::build_decay(int max_steps) {
+    // one step of an untouched column, [w; d] <- A [w; d] with
+    // d' = m d - c w, w' = w + d'
+    double m = m_momentum;
+    double c = (1 - m_momentum) * m_alpha * m_lambda;
+    m_decay.resize(4 * (max_steps + 1));
+    m_decay[0] = 1;
+    m_decay[1] = 0;
+    m_decay[2] = 0;
+    m_decay[3] = 1;
+    for (int k=1; k<=max_steps; k++) {
+        const double *p = &m_decay[4 * (k - 1)];
+        double *q = &m_decay[4 * k];
+        q[0] = (1 - c) * p[0] + m * p[2];
+        q[1] = (1 - c) * p[1] + m * p[3];
+        q[2] = -c * p[0] + m * p[2];
+        q[3] = -c * p[1] + m * p[3];
+    }
 }
 
-double LR::train_mini_batch(int st, int thread_id) {
-    int ed = min(st + m_batch_size, (int)m_samples.size());
-    if (ed < st) return 0;
-    SparseMat *x = create_sparse_matrix(m_feature_size, ed - st, 
-            m_samples, m_idx, st, ed);
+template <typename Real>
+template <int K>
+void LR<Real>::catch_up(Real *w, Real *d, int k) {
+    if (k <= 0) return;
+    const int k_cnt = classes<K>(m_output_size);
+    const double *a = &m_decay[4 * k];
+    for (int c=0; c<k_cnt; c++) {
+        Real wc = relaxed_load(w + c);
+        Real dc = relaxed_load(d + c);
+        // other threads may move w meanwhile, so add the change
+        // instead of storing the new value
+        relaxed_add(w + c, (Real)((a[0] - 1) * wc + a[1] * dc));
+        relaxed_store(d + c, (Real)(a[2] * wc + a[3] * dc));
+    }
+}
 
-    DenseMat *y = forward(x);
+template <typename Real>
+template <int K>
+void LR<Real>::flush() {
+    const int k_cnt = classes<K>(m_output_size);
+    Real *pw = w->data();
+    Real *pd = m_state.data();
+    int step = m_step;
+    for (int j=0; j<m_feature_size; j++) {
+        catch_up<K>(pw + (size_t)j * k_cnt, pd + (size_t)j * k_cnt,
+                step - m_last[j]);
+        m_last[j] = step;
+    }
+}
 
-    double l = 0;
-    for (int j=st; j<ed; j++) {
-        double t = (*y)(m_samples[m_idx[j]]->label, j - st);
-        l += log(t);
+template <typename Real>
+template <int K>
+double LR<Real>::train_mini_batch(int next, int thread_id) {
+    Workspace<Real> &ws = *m_ws[thread_id];
+    const Dataset &batch = ws.batch;
+    const int k_cnt = classes<K>(m_output_size);
+    int B = m_batch_size;
+    int n = batch.size();
+    int next_ed = min(next + B, (int)m_idx.size());
+    Real *pw = w->data();
+    Real *pd = m_state.data();
+    Real *y = ws.logits.data();
+    int step = m_step.fetch_add(1, memory_order_relaxed) + 1;
+    ws.begin_batch(batch.nnz());
+    ws.grad.clear();
+
+    // logits, a column seen for the first time in this batch gets a
+    // gradient slot, and with momentum SGD first gets the
+    // regularization steps it skipped
+    for (int i=0; i<n; i++) {
+        const Feat *f = batch.row(i);
+        int len = batch.len(i);
+        // the row offset and label of the next batch are random reads,
+        // start them now so the scatter pass below can use them
+        if (next + i < next_ed) {
+            int r = m_idx[next + i];
+            __builtin_prefetch(&m_data->offsets[r]);
+            __builtin_prefetch(&m_data->labels[r]);
+        }
+        for (int c=0; c<k_cnt; c++) {
+            y[c * B + i] = 0;
+        }
+        int *fs = ws.feat_slot.data() + batch.offsets[i];
+        for (int k=0; k<len; k++) {
+            size_t j = f[k].id;
+            bool added;
+            fs[k] = ws.touch(j, added);
+            if (added) {
+                ws.grad.resize(ws.grad.size() + k_cnt, 0);
+                if (m_optimizer == OPT_SGD) {
+                    int last = relaxed_max(&m_last[j], step);
+                    catch_up<K>(pw + j * k_cnt, pd + j * k_cnt,
+                            step - 1 - last);
+                }
+            }
+            for (int c=0; c<k_cnt; c++) {
+                y[c * B + i] += relaxed_load(pw + j * k_cnt + c)
+                    * f[k].value;
+            }
+        }
     }
 
-    DenseMat *truth = create_dense_matrix(m_output_size, ed - st, 
-            m_samples, m_idx, st, ed);
+    // softmax and log likelihood of the whole batch at once
+    double l = softmax(y, k_cnt, n, B, batch.labels.data());
+    m_profiler->lap(thread_id, PHASE_FORWARD);
 
-    *dw[thread_id] *= m_momentum;
-    *dw[thread_id] += (1 - m_momentum) * m_alpha * ( ((*truth) - (*y))
-            * x->transpose() - m_lambda * (*w));
+    // scatter (truth - y) x^T into the touched columns, and pull the
+    // rows of the next batch into the cache for gather(). The
+    // predicted class is counted for the training error on the way
+    Real *pg = ws.grad.data();
+    int correct = 0;
+    double sq_err = 0;
+    for (int i=0; i<n; i++) {
+        const Feat *f = batch.row(i);
+        int len = batch.len(i);
+        int label = batch.label(i);
+        if (next + i < next_ed) {
+            int r = m_idx[next + i];
+            prefetch(m_data->row(r), m_data->len(r) * sizeof(Feat));
+        }
+        // the residual lives in registers when K is known
+        Real buf[K > 0 ? K : 1];
+        Real *p = K > 0 ? buf : ws.residual.data();
+        Real maxv = 0;
+        int maxy = 0;
+        for (int c=0; c<k_cnt; c++) {
+            Real v = y[c * B + i];
+            p[c] = (c == label) - v;
+            if (v > maxv) {
+                maxv = v;
+                maxy = c;
+            }
+        }
+        correct += maxy == label;
+        sq_err += sqr(maxy - label);
+        const int *fs = ws.feat_slot.data() + batch.offsets[i];
+        for (int k=0; k<len; k++) {
+            Real *g = pg + (size_t)fs[k] * k_cnt;
+            for (int c=0; c<k_cnt; c++) {
+                g[c] += p[c] * f[k].value;
+            }
+        }
+    }
 
-    *w += *dw[thread_id]; 
+    ws.correct += correct;
+    ws.sq_err += sq_err;
+    m_profiler->lap(thread_id, PHASE_GRADIENT);
 
-    delete x;
-    delete y;
-    delete truth;
+    (this->*m_update)(ws, step);
+    m_profiler->lap(thread_id, PHASE_UPDATE);
 
     return l;
 }
 
+template <typename Real>
+template <int K, int OPT>
+void LR<Real>::update(Workspace<Real> &ws, int step) {
+    const int k_cnt = classes<K>(m_output_size);
+    size_t size = (size_t)k_cnt * m_feature_size;
+    Real *pw = w->data();
+    Real *s0 = m_state.data();
+    Real *s1 = OPT == OPT_ADAM || OPT == OPT_FTRL ? s0 + size : NULL;
+    const Real *pg = ws.grad.data();
+    Real alpha = m_alpha;
+    Real lambda = m_lambda;
+    Real a = (1 - m_momentum) * m_alpha;
+    Real momentum = m_momentum;
+    Real l1 = m_l1;
+    Real beta = m_ftrl_beta;
+    // the Adam step size with the bias correction of both moments
+    Real rate = OPT == OPT_ADAM ? m_alpha * sqrt(1 - pow(ADAM_BETA2, step))
+        / (1 - pow(ADAM_BETA1, step)) : 0;
+
+    // only the touched columns are written, each write is a lock-free
+    // add or store, and the L2 term of the untouched columns waits
+    // for catch_up() with momentum SGD and for their next touch else.
+    // g is the gradient of the log likelihood, which is maximized
+    for (int t=0; t<(int)ws.touched.size(); t++) {
+        size_t j = ws.touched[t];
+        for (int c=0; c<k_cnt; c++) {
+            size_t q = j * k_cnt + c;
+            Real g = pg[(size_t)t * k_cnt + c];
+            Real wq = relaxed_load(pw + q);
+            if (OPT == OPT_SGD) {
+                Real d = momentum * relaxed_load(s0 + q)
+                    + a * (g - lambda * wq);
+                relaxed_store(s0 + q, d);
+                relaxed_add(pw + q, d);
+            }
+            else if (OPT == OPT_ADAGRAD) {
+                Real dg = lambda * wq - g;
+                Real h = relaxed_load(s0 + q) + dg * dg;
+                relaxed_store(s0 + q, h);
+                relaxed_add(pw + q,
+                        (Real)(-alpha * dg / (sqrt(h) + OPTIMIZER_EPS)));
+            }
+            else if (OPT == OPT_ADAM) {
+                Real dg = lambda * wq - g;
+                Real m1 = ADAM_BETA1 * relaxed_load(s0 + q)
+                    + (1 - ADAM_BETA1) * dg;
+                Real m2 = ADAM_BETA2 * relaxed_load(s1 + q)
+                    + (1 - ADAM_BETA2) * dg * dg;
+                relaxed_store(s0 + q, m1);
+                relaxed_store(s1 + q, m2);
+                relaxed_add(pw + q,
+                        (Real)(-rate * m1 / (sqrt(m2) + OPTIMIZER_EPS)));
+            }
+            else {
+                // FTRL-Proximal, z and n per weight, w is solved from
+                // them in closed form and stored
+                Real dg = -g;
+                Real n0 = relaxed_load(s1 + q);
+                Real n1 = n0 + dg * dg;
+                Real z = relaxed_load(s0 + q) + dg
+                    - (sqrt(n1) - sqrt(n0)) / alpha * wq;
+                relaxed_store(s0 + q, z);
+                relaxed_store(s1 + q, n1);
+                Real wn = 0;
+                if (fabs(z) > l1) {
+                    wn = -(z - copysign(l1, z))
+                        / ((beta + sqrt(n1)) / alpha + lambda);
+                }
+                relaxed_store(pw + q, wn);
+            }
+        }
+    }
+}
+
+template class LR<double>;
+template class LR<float>;
@@ -7,56 +7,247 @@
 #define LR_HEADER
 
 #include "Config.h"
-#include "Sample.h"
+#include "Dataset.h"
 #include "Matrix.h"
+#include "ThreadPool.h"
+#include "ModelFile.h"
+#include "FeatureHash.h"
+#include "Optimizer.h"
+#include "Profiler.h"
 #include <vector>
+#include <atomic>
+#include <string>
+#include <cstdio>
+
+template <typename Real>
+class LRBench;
 
 /*
- * The class to run the logistic regression
+ * The class to run the logistic regression. Real is the scalar type of
+ * the weights and activations, double or float
  */
+template <typename Real>
 class LR {
+    // times the private kernels, see Bench.cpp
+    friend class LRBench<Real>;
     public:
         /*
          * Constructor, read the hyperprameters
          * and initialize member variables
          */
         LR(Config cfg);
+        ~LR();
         /*
          * The method of train. will print log likelihood each iteration
          * and RMSE every 10 iteration
-         * Use hogwild! multi-thread training to accelarate
+         * Use hogwild! multi-thread training to accelarate, threads
+         * share w without locks and only write the columns their
+         * minibatch touches, see Atomic.h
          */
         void train(const char *train_filename, const char *out_filename);
+        /*
+         * train() on samples already in memory, the rows of data or
+         * all of them if rows is NULL. The ids of data must have gone
+         * through prepare_features(), and data can be shared by models
+         * training at the same time. Writes no result file
+         */
+        void fit(const Dataset &data, const std::vector<int> *rows);
+        /*
+         * the accuracy and RMSE of the predictions on data, prepared as
+         * for fit()
+         */
+        void evaluate(const Dataset &data, double &acc, double &rmse);
         /*
          * Calculate the result of testing set, store to file
          */
         void test(const char *test_filename, const char *out_filename);
+        /*
+         * Write w to a model file, see ModelFile.h
+         */
+        void save(const char *filename);
+        /*
+         * Write the columns of w with a weight above threshold in
+         * magnitude to a sparse model file, see ModelFile.h
+         */
+        void save_sparse(const char *filename, double threshold);
+        /*
+         * Map a model file saved with the same class count, feature
+         * size and scalar type, and predict with its weights in place,
+         * looking up the columns of a sparse model by feature id.
+         * A later train() starts from the loaded weights
+         */
+        void load(const char *filename);
+        /*
+         * Predict the class and expectation of every sample of data
+         * on the calling thread, for callers that collect their own
+         * batches. The ids of data are hashed in place in hashing mode.
+         * Not safe to call concurrently with itself or with train()
+         * and test()
+         */
+        void score(Dataset &data,
+                std::vector<std::pair<int, double>> &pred);
+        /*
+         * the average loss of every training iteration so far
+         */
+        const std::vector<double> &loss_history() const {
+            return m_history;
+        }
     private:
         /*
-         * Train each mini batch, return the loss on this batch
+         * train() for files larger than memory: read the file in
+         * chunks and train each epoch chunk by chunk
+         */
+        void train_stream(const char *train_filename,
+                const char *out_filename);
+        /*
+         * allocate and randomly initialize w and the optimizer state,
+         * unless they already are
+         */
+        void init_weights();
+        /*
+         * allocate w and copy the weights of a loaded model into it
+         * before training
+         */
+        void warm_start();
+        /*
+         * save the models the config asks for after training
+         */
+        void save_trained();
+        /*
+         * save a checkpoint after iteration iter if one is due
+         */
+        void checkpoint(int iter);
+        /*
+         * prepare_features() for this model
+         */
+        void prepare(Dataset &data, HashStats *stats);
+        /*
+         * the iterations of training on the samples in m_data, logging
+         * the loss and error and saving checkpoints
+         */
+        void train_epochs();
+        /*
+         * train one pass over the samples in m_data in random order,
+         * return the summed loss
+         */
+        double run_epoch();
+        /*
+         * the training threads, started on first use so a model that
+         * only scores in the calling thread has none
+         */
+        ThreadPool *pool();
+        /*
+         * clear the busy time and the training error of all threads,
+         * and format the busy and idle time of all threads for the
+         * iteration log line
+         */
+        void reset_stats();
+        std::string busy_summary(double epoch_time);
+        /*
+         * the correct predictions and summed squared error of the
+         * minibatches trained since reset_stats(), each sample scored
+         * by its forward pass just before its update
+         */
+        void train_error(double &acc, double &se);
+        /*
+         * The kernels below are specialized on the class count K so
+         * the per-class loops are fixed size and unrolled, K = 0 is the
+         * generic version using m_output_size. set_kernels<K>() picks
+         * the specializations the model uses
+         */
+        template <int K>
+        void set_kernels();
+        /*
+         * copy the samples st .. ed - 1 of m_idx into the batch of the
+         * workspace of thread_id
+         */
+        void gather(int st, int ed, int thread_id);
+        /*
+         * Train the gathered mini batch of thread_id, return the loss on
+         * this batch. next is the start in m_idx of the batch the thread
+         * trains after this one, its samples are prefetched meanwhile
+         */
+        template <int K>
+        double train_mini_batch(int next, int thread_id);
+        /*
+         * apply the optimizer step OPT of minibatch step to the
+         * columns the batch in ws touched
          */
-        double train_mini_batch(int st, int thread_id);
+        template <int K, int OPT>
+        void update(Workspace<Real> &ws, int step);
         /*
-         * The training process of each thread
+         * precompute the powers of the regularization step of an
+         * untouched column, for up to max_steps skipped steps
+         */
+        void build_decay(int max_steps);
+        /*
+         * apply k skipped regularization steps of momentum SGD to one
+         * column of w and of the momentum d
+         */
+        template <int K>
+        void catch_up(Real *w, Real *d, int k);
+        /*
+         * bring every column of w up to date with the last step, for
+         * momentum SGD
+         */
+        template <int K>
+        void flush();
+        /*
+         * The training process of each thread, pulls minibatches
+         * until the epoch is exhausted
          */
         void train_thread(int thread_id);
         /*
-         * Predict the class and expectation of input
+         * Predict the class and expectation of every sample in m_data.
+         * The samples are scored in blocks of m_predict_batch by all
+         * threads, a few blocks per thread at a time, so the memory
+         * does not grow with the dataset. Return the number of correct
+         * predictions and the summed squared error in acc and se, and
+         * write the predictions to fo in sample order unless it is NULL
+         */
+        void predict(FILE *fo, double &acc, double &se);
+        /*
+         * The scoring process of each thread, pulls blocks until block
+         * last, and formats their results into m_text if text is set
+         */
+        void predict_thread(int thread_id, int first, int last, bool text);
+        /*
+         * Predict m_data and dump the result to file
+         */
+        void print_result(const char *out_filename, double &acc,
+                double &se);
+        /*
+         * Use input and weight to calculate the class probabilities of
+         * samples st .. ed - 1, stored class-major into y. SPARSE looks
+         * the weight columns up in a sparse model
          */
-        std::vector<std::pair<int, double>> predict();
+        template <int K, bool SPARSE>
+        void forward(int st, int ed, Real *y);
         /*
-         * Dump the result to file
+         * forward samples st .. ed - 1 into y and store the predicted
+         * class and expectation of sample i into pred[i - st]
          */
-        void print_result(const char *out_filename);
+        template <int K>
+        void predict_block(int st, int ed, Real *y,
+                std::pair<int, double> *pred);
+
         /*
-         * Use input and weight to calculate output
+         * the specializations chosen for m_output_size
          */
-        DenseMat *forward(SparseMat *x);
+        double (LR::*m_train_mini_batch)(int next, int thread_id);
+        void (LR::*m_update)(Workspace<Real> &ws, int step);
+        void (LR::*m_flush)();
+        void (LR::*m_predict_block)(int st, int ed, Real *y,
+                std::pair<int, double> *pred);
 
         /*
          * input samples
          */
-        std::vector<Sample*> m_samples;
+        Dataset *m_data;
+        /*
+         * the samples of m_data to train on, NULL for all
+         */
+        const std::vector<int> *m_rows;
         /*
          * idx use to random shuffle the input samples
          */
@@ -65,27 +256,107 @@ class LR {
         /*
          * the parameter w
          */
-        DenseMat *w;
+        DenseMatT<Real> *w;
+        /*
+         * the weights predict() reads, w or a mapped model file
+         */
+        const Real *m_weight;
+        ModelFile *m_model;
         /*
-         * The gradient of w for each thread
+         * The state of the optimizer, optimizer_slots() arrays of the
+         * size and layout of w, shared by all threads
          */
-        std::vector<DenseMat*> dw;
+        std::vector<Real> m_state;
+        /*
+         * the step each feature column was last brought up to date,
+         * used for the lazy L2 regularization of momentum SGD
+         */
+        std::vector<int> m_last;
+        /*
+         * The number of minibatches trained so far by all threads
+         */
+        std::atomic<int> m_step;
+        /*
+         * The reusable minibatch buffers of each thread
+         */
+        std::vector<Workspace<Real>*> m_ws;
+        /*
+         * The powers of the 2x2 step matrix of an untouched column,
+         * 4 entries per power
+         */
+        std::vector<double> m_decay;
+        /*
+         * The average loss of each iteration
+         */
+        std::vector<double> m_history;
         /*
          * The loss of each thread
          */
-        std::vector<double> l;
+        std::vector<Padded<double>> l;
+        /*
+         * The time each thread spent working in the last epoch
+         */
+        std::vector<Padded<double>> m_busy;
+        /*
+         * The start of the next unclaimed minibatch in m_idx
+         */
+        std::atomic<int> m_cursor;
+        /*
+         * The formatted result lines of the blocks in flight in
+         * predict(), one string per block
+         */
+        std::vector<std::string> m_text;
+        /*
+         * The training threads, alive as long as the model once
+         * started, and whether and from where they are pinned
+         */
+        ThreadPool *m_pool;
+        bool m_affinity;
+        int m_first_cpu;
+        /*
+         * The time of each phase, per training thread and for the
+         * calling thread in slot m_thread_cnt
+         */
+        Profiler *m_profiler;
 
         /*
          * training hyper parameters
          */
         int m_batch_size;
         int m_feature_size;
+        // log2 of the bucket count in hashing mode, 0 for no hashing
+        int m_hash_bits;
         double m_alpha;
         double m_lambda;
         double m_momentum;
+        Optimizer m_optimizer;
+        // the L1 and the beta of FTRL-Proximal
+        double m_l1;
+        double m_ftrl_beta;
         int m_output_size;
         int m_iter_cnt;
         int m_thread_cnt;
+        int m_predict_batch;
+        /*
+         * stream the training file instead of loading it, and the
+         * bytes of the file held in memory per chunk
+         */
+        bool m_stream;
+        size_t m_stream_buffer;
+        // read the record offsets from the .idx sidecars
+        bool m_sample_index;
+        /*
+         * where to save the model, empty for not saving, and the
+         * iterations between checkpoints, 0 for only the final one
+         */
+        std::string m_model_filename;
+        int m_checkpoint;
+        /*
+         * where to save the pruned sparse model, empty for not saving,
+         * and the magnitude up to which weights are pruned
+         */
+        std::string m_sparse_model_filename;
+        double m_prune;
 };
 
 #endif
@@ -4,24 +4,259 @@
  */
 
 #include "Log.h"
+#include "ThreadPool.h"
 #include <cstdarg>
+#include <cstring>
+#include <chrono>
 
-void Log::initialize(const char *log_filename) {
+using namespace std;
+
+/*
+ * The logs of one thread on their way to the writer. The thread
+ * appends records at head and the writer takes them at tail, so the
+ * ring needs no lock. head and tail only grow, their position in buf
+ * is modulo CAPACITY
+ */
+struct LogRing {
+    static const size_t CAPACITY = 1 << 16;
+
+    Padded<atomic<size_t>> head;
+    Padded<atomic<size_t>> tail;
+    // set when the thread exits, the writer frees the ring once empty
+    atomic<bool> closed;
+    char buf[CAPACITY];
+
+    LogRing() {
+        head.v = 0;
+        tail.v = 0;
+        closed = false;
+    }
+
+    void put(size_t pos, const void *src, size_t n) {
+        size_t p = pos % CAPACITY;
+        size_t first = min(n, CAPACITY - p);
+        memcpy(buf + p, src, first);
+        memcpy(buf, (const char *)src + first, n - first);
+    }
+
+    void get(size_t pos, void *dst, size_t n) const {
+        size_t p = pos % CAPACITY;
+        size_t first = min(n, CAPACITY - p);
+        memcpy(dst, buf + p, first);
+        memcpy((char *)dst + first, buf, n - first);
+    }
+};
+
+/*
+ * The header of each record in a ring, followed by len bytes of text
+ */
+struct LogRecord {
+    unsigned long long seq;
+    size_t len;
+};
+
+/*
+ * The ring of the calling thread, closed when the thread exits
+ */
+struct RingOwner {
+    LogRing *ring;
+
+    RingOwner() : ring(NULL) {}
+    ~RingOwner() {
+        if (ring != NULL) {
+            ring->closed.store(true, memory_order_release);
+        }
+    }
+};
+
+static thread_local RingOwner owner;
+
+void Log::initialize(const char *log_filename, FILE *echo) {
     log_file = fopen(log_filename, "w");
+    echo_file = echo;
+    stop = false;
+    writer = new thread(write_loop);
 }
 
 void Log::close() {
+    {
+        lock_guard<mutex> lock(writer_mutex);
+        stop = true;
+    }
+    writer_cond.notify_one();
+    writer->join();
+    delete writer;
+    writer = NULL;
+    drain();
     fclose(log_file);
+    log_file = NULL;
+}
+
+void Log::flush() {
+    drain();
+}
+
+void Log::set_quiet(bool q) {
+    quiet = q;
 }
 
 void Log::log(const char* const fmt, ...) {
+    if (quiet) {
+        return;
+    }
+    // format once for both outputs, on the stack unless it is long
+    char line[1024];
+    string long_line;
     va_list arg;
+    va_list arg_copy;
     va_start(arg, fmt);
-    vfprintf(stdout, fmt, arg);
-    fflush(stdout);
-    vfprintf(log_file, fmt, arg);
-    fflush(log_file);
+    // a va_list is consumed by vsnprintf, format again from a copy
+    va_copy(arg_copy, arg);
+    int len = vsnprintf(line, sizeof(line), fmt, arg);
+    const char *text = line;
+    if (len >= (int)sizeof(line)) {
+        long_line.resize(len + 1);
+        vsnprintf(&long_line[0], len + 1, fmt, arg_copy);
+        text = long_line.data();
+    }
+    va_end(arg_copy);
     va_end(arg);
+    if (len < 0) {
+        return;
+    }
+
+    LogRing *r = owner.ring;
+    if (r == NULL) {
+        r = owner.ring = new LogRing();
+        lock_guard<mutex> lock(rings_mutex);
+        rings.push_back(r);
+    }
+    LogRecord rec;
+    rec.len = min((size_t)len, LogRing::CAPACITY / 2 - sizeof(rec));
+    size_t need = sizeof(rec) + rec.len;
+    size_t head = r->head.v.load(memory_order_relaxed);
+    while (head + need - r->tail.v.load(memory_order_acquire)
+            > LogRing::CAPACITY) {
+        // the writer fell behind, make room on this thread
+        drain();
+    }
+    rec.seq = next_seq.fetch_add(1, memory_order_relaxed);
+    r->put(head, &rec, sizeof(rec));
+    r->put(head + sizeof(rec), text, rec.len);
+    // the writer sets writer_idle before it looks at the rings a last
+    // time, in the one order of the seq_cst operations either it sees
+    // this log or this thread sees it idle
+    r->head.v.store(head + need, memory_order_seq_cst);
+    if (writer_idle.load(memory_order_seq_cst)) {
+        {
+            lock_guard<mutex> lock(writer_mutex);
+            writer_idle.store(false, memory_order_relaxed);
+        }
+        writer_cond.notify_one();
+    }
+}
+
+void Log::write_loop() {
+    unique_lock<mutex> lock(writer_mutex);
+    while (!stop) {
+        lock.unlock();
+        drain();
+        lock.lock();
+        // sleep until a log wakes the writer, the timeout is only a
+        // safety net
+        writer_idle.store(true, memory_order_seq_cst);
+        if (!stop && !pending()) {
+            writer_cond.wait_for(lock, chrono::seconds(1), [] {
+                    return stop || !writer_idle.load(memory_order_relaxed);
+                    });
+        }
+        writer_idle.store(false, memory_order_relaxed);
+    }
+}
+
+bool Log::pending() {
+    lock_guard<mutex> lock(rings_mutex);
+    for (LogRing *r : rings) {
+        if (r->tail.v.load(memory_order_relaxed)
+                != r->head.v.load(memory_order_seq_cst)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Log::drain() {
+    lock_guard<mutex> drain_lock(drain_mutex);
+    vector<LogRing*> snapshot;
+    {
+        lock_guard<mutex> lock(rings_mutex);
+        snapshot = rings;
+    }
+
+    // merge the rings by sequence number, the first record of each
+    // ring is its oldest
+    string out;
+    while (true) {
+        LogRing *oldest = NULL;
+        LogRecord first;
+        for (LogRing *r : snapshot) {
+            size_t tail = r->tail.v.load(memory_order_relaxed);
+            if (tail == r->head.v.load(memory_order_acquire)) {
+                continue;
+            }
+            LogRecord rec;
+            r->get(tail, &rec, sizeof(rec));
+            if (oldest == NULL || rec.seq < first.seq) {
+                oldest = r;
+                first = rec;
+            }
+        }
+        if (oldest == NULL) {
+            break;
+        }
+        size_t tail = oldest->tail.v.load(memory_order_relaxed);
+        size_t st = out.size();
+        out.resize(st + first.len);
+        oldest->get(tail + sizeof(first), &out[st], first.len);
+        oldest->tail.v.store(tail + sizeof(first) + first.len,
+                memory_order_release);
+    }
+
+    if (!out.empty()) {
+        fwrite(out.data(), 1, out.size(), echo_file);
+        fflush(echo_file);
+        if (log_file != NULL) {
+            fwrite(out.data(), 1, out.size(), log_file);
+            fflush(log_file);
+        }
+    }
+
+    // free the rings of the threads that exited
+    lock_guard<mutex> lock(rings_mutex);
+    for (size_t i=0; i<rings.size(); ) {
+        LogRing *r = rings[i];
+        if (r->closed.load(memory_order_acquire)
+                && r->head.v.load(memory_order_acquire)
+                == r->tail.v.load(memory_order_relaxed)) {
+            delete r;
+            rings[i] = rings.back();
+            rings.pop_back();
+        }
+        else {
+            i++;
+        }
+    }
 }
 
 FILE *Log::log_file = NULL;
+FILE *Log::echo_file = stdout;
+thread_local bool Log::quiet = false;
+vector<LogRing*> Log::rings;
+mutex Log::rings_mutex;
+mutex Log::drain_mutex;
+atomic<unsigned long long> Log::next_seq(0);
+thread *Log::writer = NULL;
+mutex Log::writer_mutex;
+condition_variable Log::writer_cond;
+bool Log::stop = false;
+atomic<bool> Log::writer_idle(false);
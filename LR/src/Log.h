@@ -8,26 +8,80 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
 
 #define LOG(...) Log::log(__VA_ARGS__)
 
+struct LogRing;
+
+/*
+ * An asynchronous log. log() formats the message once into a ring
+ * buffer of the calling thread and returns, a background thread writes
+ * the messages of all threads to the log file and the echo stream in
+ * the order they were logged. A thread only waits when its ring is full
+ */
 class Log {
     public:
         /*
-         * open log file
+         * open log file and start the writer, every log is also
+         * printed to echo
          */
-        static void initialize(const char *log_filename);
+        static void initialize(const char *log_filename,
+                FILE *echo = stdout);
         /*
-         * close log file
+         * write out all logs, stop the writer and close log file
          */
         static void close();
+        /*
+         * return once every log made so far is written out
+         */
+        static void flush();
+        /*
+         * drop the logs of the calling thread while quiet is set
+         */
+        static void set_quiet(bool quiet);
         /*
          * write a log, like printf format
          */
         static void log(const char* const fmt, ...);
 
     private:
+        /*
+         * the loop of the writer thread
+         */
+        static void write_loop();
+        /*
+         * write out the logs in the rings in order
+         */
+        static void drain();
+        /*
+         * whether a ring holds logs not written out yet
+         */
+        static bool pending();
+
         static FILE *log_file;
+        static FILE *echo_file;
+        static thread_local bool quiet;
+
+        // the rings of all threads that logged, guarded by rings_mutex
+        static std::vector<LogRing*> rings;
+        static std::mutex rings_mutex;
+        // one drain() at a time, by the writer or by flush()
+        static std::mutex drain_mutex;
+        // the order of the logs across threads
+        static std::atomic<unsigned long long> next_seq;
+        static std::thread *writer;
+        static std::mutex writer_mutex;
+        static std::condition_variable writer_cond;
+        static bool stop;
+        // set while the writer sleeps with nothing to write, the next
+        // log() clears it and wakes the writer
+        static std::atomic<bool> writer_idle;
 };
 
 #endif
@@ -5,11 +5,98 @@
 #include "Utils.h"
 #include "LR.h"
 #include "Log.h"
+#include "Sweep.h"
+#include "CompactFile.h"
+#include "Softmax.h"
+#include <sys/stat.h>
 
 Config cfg;
 
 using namespace std;
 
+/*
+ * train a model with scalar type Real, score the dev and test sets,
+ * and return the loss of each training iteration. suffix is appended
+ * to the output filenames
+ */
+template <typename Real>
+vector<double> run(const string &suffix) {
+    Config run_cfg = cfg;
+    if (!run_cfg.model_filename.empty()) {
+        run_cfg.model_filename += suffix;
+    }
+    if (!run_cfg.sparse_model_filename.empty()) {
+        run_cfg.sparse_model_filename += suffix;
+    }
+    if (!run_cfg.profile_trace.empty()) {
+        // before the extension, which picks the trace format
+        size_t dot = run_cfg.profile_trace.rfind('.');
+        if (dot == string::npos) {
+            dot = run_cfg.profile_trace.size();
+        }
+        run_cfg.profile_trace.insert(dot, suffix);
+    }
+    LR<Real> lr(run_cfg);
+    lr.train((cfg.feature_filename_train + cfg.feature_suffix).c_str(),
+             (cfg.output_filename_train + suffix).c_str());
+    lr.test((cfg.feature_filename_dev + cfg.feature_suffix).c_str(),
+            (cfg.output_filename_dev + suffix).c_str());
+    lr.test((cfg.feature_filename_test + cfg.feature_suffix).c_str(),
+            (cfg.output_filename_test + suffix).c_str());
+    return lr.loss_history();
+}
+
+/*
+ * load the saved model and score the dev and test sets without training
+ */
+template <typename Real>
+void score() {
+    LR<Real> lr(cfg);
+    lr.load(cfg.model_filename.c_str());
+    lr.test((cfg.feature_filename_dev + cfg.feature_suffix).c_str(),
+            cfg.output_filename_dev.c_str());
+    lr.test((cfg.feature_filename_test + cfg.feature_suffix).c_str(),
+            cfg.output_filename_test.c_str());
+}
+
+/*
+ * write the .bin file of every set again in the compact format
+ */
+void convert() {
+    const string sets[] = {cfg.feature_filename_train,
+        cfg.feature_filename_dev, cfg.feature_filename_test};
+    for (const string &name : sets) {
+        string in = name + ".bin";
+        string out = name + ".lrc";
+        Dataset *data = read_sample(in.c_str(), cfg.thread_cnt);
+        write_compact(*data, out.c_str());
+        delete data;
+        struct stat in_st;
+        struct stat out_st;
+        if (stat(in.c_str(), &in_st) == 0
+                && stat(out.c_str(), &out_st) == 0) {
+            LOG("convert %s: %lld -> %lld bytes, %.2fx\n", in.c_str(),
+                    (long long)in_st.st_size, (long long)out_st.st_size,
+                    (double)in_st.st_size / max(out_st.st_size, (off_t)1));
+        }
+    }
+}
+
+/*
+ * train in double and in single precision from the same seed and log
+ * how far the float losses drift from the double ones
+ */
+void compare() {
+    srandom(1);
+    vector<double> ld = run<double>("");
+    srandom(1);
+    vector<double> lf = run<float>(".float");
+    LOG("iter, double l, float l, diff\n");
+    for (int i=0; i<(int)min(ld.size(), lf.size()); i++) {
+        LOG("%d, %.10f, %.10f, %.3e\n", i + 1, ld[i], lf[i], lf[i] - ld[i]);
+    }
+}
+
 /*
  * The main routine
  */
@@ -23,14 +110,49 @@ int main(int argc, char **argv) {
     cfg.parse(argv[1]);
 
     Log::initialize("log.txt");
+    // before any model, the sweep builds them on several threads
+    softmax_select(cfg.simd);
 
-    LR lr(cfg);
-    lr.train((cfg.feature_filename_train + ".bin").c_str(),
-             cfg.output_filename_train.c_str());
-    lr.test((cfg.feature_filename_dev + ".bin").c_str(),
-            cfg.output_filename_dev.c_str());
-    lr.test((cfg.feature_filename_test + ".bin").c_str(),
-            cfg.output_filename_test.c_str());
+    if (cfg.mode == "score") {
+        if (cfg.precision == "double") {
+            score<double>();
+        }
+        else if (cfg.precision == "float") {
+            score<float>();
+        }
+        else {
+            throw "unknown precision";
+        }
+    }
+    else if (cfg.mode == "convert") {
+        convert();
+    }
+    else if (cfg.mode == "sweep") {
+        if (cfg.precision == "double") {
+            sweep<double>(cfg);
+        }
+        else if (cfg.precision == "float") {
+            sweep<float>(cfg);
+        }
+        else {
+            throw "unknown precision";
+        }
+    }
+    else if (cfg.mode != "train") {
+        throw "unknown mode";
+    }
+    else if (cfg.precision == "double") {
+        run<double>("");
+    }
+    else if (cfg.precision == "float") {
+        run<float>("");
+    }
+    else if (cfg.precision == "compare") {
+        compare();
+    }
+    else {
+        throw "unknown precision";
+    }
 
     Log::close();
 
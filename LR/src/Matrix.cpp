@@ -5,56 +5,46 @@
 
 #include "Matrix.h"
 
-using namespace Eigen;
-
-typedef Eigen::Triplet<float> T;
+template <typename Real>
+Workspace<Real>::Workspace(int output_size, int batch_size) {
+    SlotEntry empty = {0, 0, 0};
+    m_table_bits = 10;
+    m_table.assign((size_t)1 << m_table_bits, empty);
+    m_gen = 0;
+    logits.resize((size_t)output_size * batch_size);
+    residual.resize(output_size);
+    correct = 0;
+    sq_err = 0;
+}
 
-SparseMat *create_sparse_matrix(
-        int row, int col,
-        const std::vector<Sample*> &samples) {
-    SparseMat *ret = new SparseMat(row, col);
-    ret->setZero();
-    std::vector<T> t;
-    for (int i=0; i<(int)samples.size(); i++) {
-        Sample *s = samples[i];
-        // p: feat id, value
-        for (auto &p : s->feat) {
-            t.push_back(T(p.first, i, p.second));
-        }
+template <typename Real>
+void Workspace<Real>::begin_batch(size_t nnz) {
+    touched.clear();
+    feat_slot.resize(nnz);
+    if (++m_gen == 0) {
+        // the generations wrapped, the old entries could match again
+        SlotEntry empty = {0, 0, 0};
+        m_table.assign(m_table.size(), empty);
+        m_gen = 1;
     }
-    ret->setFromTriplets(t.begin(), t.end());
-    return ret;
 }
 
-SparseMat *create_sparse_matrix(
-        int row, int col,
-        const std::vector<Sample*> &samples,
-        const std::vector<int> &idx,
-        int st, int ed) {
-    SparseMat *ret = new SparseMat(row, col);
-    ret->setZero();
-    std::vector<T> t;
-    for (int i=st; i<ed; i++) {
-        Sample *s = samples[idx[i]];
-        // p: feat id, value
-        for (auto &p : s->feat) {
-            t.push_back(T(p.first, i - st, p.second));
+template <typename Real>
+void Workspace<Real>::grow() {
+    SlotEntry empty = {0, 0, 0};
+    m_table_bits++;
+    m_table.assign((size_t)1 << m_table_bits, empty);
+    int mask = (int)m_table.size() - 1;
+    for (int t=0; t<(int)touched.size(); t++) {
+        int h = hash_feature(touched[t], m_table_bits);
+        while (m_table[h].gen == m_gen) {
+            h = (h + 1) & mask;
         }
+        m_table[h].id = touched[t];
+        m_table[h].slot = t;
+        m_table[h].gen = m_gen;
     }
-    ret->setFromTriplets(t.begin(), t.end());
-    return ret;
 }
 
-DenseMat *create_dense_matrix(
-        int row, int col,
-        const std::vector<Sample*> &samples,
-        const std::vector<int> &idx,
-        int st, int ed) {
-    DenseMat *ret = new DenseMat(row, col);
-    ret->setZero();
-    for (int i=st; i<ed; i++) {
-        Sample *s = samples[idx[i]];
-        (*ret)(s->label, i - st) = 1;
-    }
-    return ret;
-}
+template class Workspace<double>;
+template class Workspace<float>;
@@ -6,40 +6,115 @@
 #ifndef MATRIX_HEADER
 #define MATRIX_HEADER
 
-#include "Eigen/Sparse"
 #include "Eigen/Dense"
 #include <vector>
-#include "Sample.h"
+#include <utility>
+#include "Dataset.h"
+#include "FeatureHash.h"
 
-typedef Eigen::SparseMatrix<double> SparseMat;
-typedef Eigen::MatrixXd DenseMat;
+template <typename Real>
+using DenseMatT = Eigen::Matrix<Real, Eigen::Dynamic, Eigen::Dynamic>;
+typedef DenseMatT<double> DenseMat;
 
 /*
- * create the input sparse matrix of whole data
+ * The reusable buffers of one worker, sized once for the largest
+ * minibatch so no batch allocates memory
  */
-SparseMat *create_sparse_matrix(
-        int row, int col,
-        const std::vector<Sample*> &samples);
+template <typename Real>
+class Workspace {
+    public:
+        Workspace(int output_size, int batch_size);
 
-/*
- * create the input sparse matrix of minibatch
- */
-SparseMat *create_sparse_matrix(
-        int row, int col,
-        const std::vector<Sample*> &samples,
-        const std::vector<int> &idx,
-        int st, int ed);
+        /*
+         * the feature columns the current batch touches, and their
+         * gradient, one column of output_size entries per touched
+         * column in the same order
+         */
+        std::vector<int> touched;
+        std::vector<Real> grad;
+        /*
+         * the position in touched of the column of each feature of the
+         * batch, in the order of batch.feats
+         */
+        std::vector<int> feat_slot;
+        /*
+         * the class scores of the batch, class-major with one row of
+         * batch_size entries per class, see softmax()
+         */
+        std::vector<Real> logits;
+        /*
+         * the samples of the batch gathered into one contiguous store,
+         * in training order
+         */
+        Dataset batch;
+        /*
+         * truth - y of one sample
+         */
+        std::vector<Real> residual;
+        /*
+         * the class probabilities and predictions of one block in
+         * predict(), grown on first use
+         */
+        std::vector<Real> scores;
+        std::vector<std::pair<int, double>> pred;
+        /*
+         * the correct predictions and summed squared error of the
+         * samples this worker scored in predict() or trained on
+         */
+        double correct;
+        double sq_err;
 
-/*
- * create the dense matrix of true label
- */
-DenseMat *create_dense_matrix(
-        int row, int col,
-        const std::vector<Sample*> &samples,
-        const std::vector<int> &idx,
-        int st, int ed);
-
-#endif
+        /*
+         * forget the columns of the last batch and make room for the
+         * slots of a batch of nnz features
+         */
+        void begin_batch(size_t nnz);
+        /*
+         * the position of column j in touched, added is set if the
+         * batch had not touched it yet and it was appended
+         */
+        int touch(int j, bool &added) {
+            int mask = (int)m_table.size() - 1;
+            int h = hash_feature(j, m_table_bits);
+            while (m_table[h].gen == m_gen) {
+                if (m_table[h].id == j) {
+                    added = false;
+                    return m_table[h].slot;
+                }
+                h = (h + 1) & mask;
+            }
+            m_table[h].id = j;
+            m_table[h].slot = touched.size();
+            m_table[h].gen = m_gen;
+            touched.push_back(j);
+            added = true;
+            if (2 * touched.size() > m_table.size()) {
+                grow();
+            }
+            return touched.size() - 1;
+        }
+    private:
+        struct SlotEntry {
+            int id;
+            int slot;
+            unsigned gen;
+        };
 
+        /*
+         * double the table and insert the columns of touched again
+         */
+        void grow();
 
+        /*
+         * an open addressing map from the columns of the batch to their
+         * position in touched, at most half full. It keeps the size the
+         * largest batch needed, so scratch is O(batch nnz) and not
+         * O(feature_size). An entry belongs to the current batch if its
+         * gen is m_gen, so a batch starts without clearing it
+         */
+        std::vector<SlotEntry> m_table;
+        int m_table_bits;
+        unsigned m_gen;
+};
 
+#endif
@@ -0,0 +1,144 @@
+/*
+ * ModelFile.cpp
+ * The definition of the model file functions and class ModelFile
+ */
+
+#include "ModelFile.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+inline uint64_t align(uint64_t x) {
+    return (x + MODEL_ALIGN - 1) / MODEL_ALIGN * MODEL_ALIGN;
+}
+
+/*
+ * write the header and the arrays at their offsets to filename through
+ * a temporary file, the arrays are given in the order of their offsets
+ */
+static void write_model(const char *filename, const ModelHeader &header,
+        const vector<pair<uint64_t, pair<const void *, uint64_t>>> &arrays) {
+    AtomicFile fo;
+    if (!fo.open(filename)) {
+        throw "cannot open model file";
+    }
+    char pad[MODEL_ALIGN] = {0};
+    fo.write(&header, sizeof(header));
+    uint64_t pos = sizeof(header);
+    for (size_t i=0; i<arrays.size(); i++) {
+        uint64_t offset = arrays[i].first;
+        fo.write(pad, offset - pos);
+        fo.write(arrays[i].second.first, arrays[i].second.second);
+        pos = offset + arrays[i].second.second;
+    }
+    if (!fo.commit()) {
+        throw "cannot write model file";
+    }
+}
+
+static void init_header(ModelHeader &header, int feature_size,
+        int class_cnt, int scalar_size, int hash_bits) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MODEL_MAGIC, sizeof(header.magic));
+    header.version = MODEL_VERSION;
+    header.scalar_size = scalar_size;
+    header.feature_size = feature_size;
+    header.class_cnt = class_cnt;
+    header.hash_bits = hash_bits;
+}
+
+void save_model(const char *filename, int feature_size, int class_cnt,
+        int scalar_size, int hash_bits, const void *weight) {
+    ModelHeader header;
+    init_header(header, feature_size, class_cnt, scalar_size, hash_bits);
+    header.layout = MODEL_DENSE;
+    header.weight_offset = align(sizeof(header));
+    header.weight_bytes = (uint64_t)feature_size * class_cnt * scalar_size;
+
+    vector<pair<uint64_t, pair<const void *, uint64_t>>> arrays;
+    arrays.push_back(make_pair(header.weight_offset,
+                make_pair(weight, header.weight_bytes)));
+    write_model(filename, header, arrays);
+}
+
+void save_sparse_model(const char *filename, int feature_size,
+        int class_cnt, int scalar_size, int hash_bits,
+        const vector<int> &ids, const void *weight) {
+    int n = ids.size();
+    // at most half full, so probes stay short
+    int table_bits = 1;
+    while ((1 << table_bits) < 2 * n) {
+        table_bits++;
+    }
+    vector<int32_t> table(1 << table_bits, -1);
+    int mask = (1 << table_bits) - 1;
+    for (int i=0; i<n; i++) {
+        int h = hash_feature(ids[i], table_bits);
+        while (table[h] >= 0) {
+            h = (h + 1) & mask;
+        }
+        table[h] = i;
+    }
+    vector<int32_t> id32(ids.begin(), ids.end());
+
+    ModelHeader header;
+    init_header(header, feature_size, class_cnt, scalar_size, hash_bits);
+    header.layout = MODEL_SPARSE;
+    header.column_cnt = n;
+    header.table_bits = table_bits;
+    header.weight_offset = align(sizeof(header));
+    header.weight_bytes = (uint64_t)n * class_cnt * scalar_size;
+    header.id_offset = align(header.weight_offset + header.weight_bytes);
+    header.table_offset = align(header.id_offset
+            + sizeof(int32_t) * id32.size());
+
+    vector<pair<uint64_t, pair<const void *, uint64_t>>> arrays;
+    arrays.push_back(make_pair(header.weight_offset,
+                make_pair(weight, header.weight_bytes)));
+    arrays.push_back(make_pair(header.id_offset,
+                make_pair((const void *)id32.data(),
+                    (uint64_t)sizeof(int32_t) * id32.size())));
+    arrays.push_back(make_pair(header.table_offset,
+                make_pair((const void *)table.data(),
+                    (uint64_t)sizeof(int32_t) * table.size())));
+    write_model(filename, header, arrays);
+}
+
+ModelFile::ModelFile(const char *filename) : m_file(filename) {
+    if (m_file.size() < sizeof(ModelHeader)) {
+        throw "corrupted model file";
+    }
+    m_header = (const ModelHeader *)m_file.data();
+
+    const ModelHeader &h = *m_header;
+    if (memcmp(h.magic, MODEL_MAGIC, sizeof(h.magic)) != 0) {
+        throw "not a model file";
+    }
+    if (h.version != MODEL_VERSION) {
+        throw "unsupported model file version";
+    }
+    bool ok = (h.scalar_size == 4 || h.scalar_size == 8)
+        && h.feature_size > 0 && h.class_cnt > 0
+        && (h.layout == MODEL_DENSE || h.layout == MODEL_SPARSE)
+        && h.hash_bits >= 0 && h.hash_bits < 31
+        && h.weight_offset % MODEL_ALIGN == 0
+        && h.weight_bytes == (uint64_t)column_cnt() * h.class_cnt
+            * h.scalar_size
+        && h.weight_offset + h.weight_bytes <= m_file.size();
+    if (ok && sparse()) {
+        ok = h.column_cnt >= 0 && h.column_cnt <= h.feature_size
+            && h.table_bits > 0 && h.table_bits < 31
+            && (1 << h.table_bits) > h.column_cnt
+            && h.id_offset % MODEL_ALIGN == 0
+            && h.table_offset % MODEL_ALIGN == 0
+            && h.id_offset + sizeof(int32_t) * h.column_cnt
+                <= m_file.size()
+            && h.table_offset + (sizeof(int32_t) << h.table_bits)
+                <= m_file.size();
+    }
+    if (!ok) {
+        throw "corrupted model file";
+    }
+}
@@ -0,0 +1,138 @@
+/*
+ * ModelFile.h
+ * The declaration of the binary model format and class ModelFile
+ */
+
+#ifndef MODEL_FILE_HEADER
+#define MODEL_FILE_HEADER
+
+#include "FeatureHash.h"
+#include "FileIO.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * The model file starts with this header, followed by the weights at
+ * weight_offset, in the byte order of the machine that wrote it.
+ * A dense model stores the weights exactly as w is in memory,
+ * class_cnt x feature_size column-major, one column of class_cnt
+ * scalars per feature.
+ * A sparse model only stores the columns of column_cnt features: the
+ * weights are class_cnt x column_cnt column-major, the feature id of
+ * each column is in the sorted int32 array at id_offset, and the int32
+ * array of 1 << table_bits entries at table_offset is an open
+ * addressing table from feature id to column, -1 for an empty entry,
+ * probed linearly from hash_feature(id, table_bits).
+ * Every offset is a multiple of MODEL_ALIGN so the mapped arrays are
+ * aligned for vector loads
+ */
+#define MODEL_MAGIC "LRMODEL"
+#define MODEL_VERSION 1
+#define MODEL_ALIGN 64
+
+#define MODEL_DENSE 0
+#define MODEL_SPARSE 1
+
+struct ModelHeader {
+    char magic[8];
+    uint32_t version;
+    // sizeof the scalar type of the weights, 4 for float, 8 for double
+    uint32_t scalar_size;
+    int32_t feature_size;
+    int32_t class_cnt;
+    uint64_t weight_offset;
+    uint64_t weight_bytes;
+    // log2 of the bucket count of a feature hashing model, else 0
+    int32_t hash_bits;
+    // MODEL_DENSE or MODEL_SPARSE, the rest of the header is only used
+    // by sparse models
+    int32_t layout;
+    int32_t column_cnt;
+    int32_t table_bits;
+    uint64_t id_offset;
+    uint64_t table_offset;
+};
+
+/*
+ * write a dense model file, the weights are class_cnt x feature_size
+ * scalars of scalar_size bytes. The file is written under a temporary
+ * name and renamed, so a reader never sees a half written checkpoint.
+ * throw on failure
+ */
+void save_model(const char *filename, int feature_size, int class_cnt,
+        int scalar_size, int hash_bits, const void *weight);
+/*
+ * write a sparse model file of the columns of the features in the
+ * ascending ids, the weights are class_cnt x ids.size() scalars.
+ * throw on failure
+ */
+void save_sparse_model(const char *filename, int feature_size,
+        int class_cnt, int scalar_size, int hash_bits,
+        const std::vector<int> &ids, const void *weight);
+
+/*
+ * A read-only memory mapping of a model file, the weights are used in
+ * place and are only valid while the ModelFile is alive
+ */
+class ModelFile {
+    public:
+        /*
+         * map the file and check the header, throw on failure
+         */
+        ModelFile(const char *filename);
+
+        int feature_size() const {
+            return m_header->feature_size;
+        }
+        int class_cnt() const {
+            return m_header->class_cnt;
+        }
+        int scalar_size() const {
+            return m_header->scalar_size;
+        }
+        int hash_bits() const {
+            return m_header->hash_bits;
+        }
+        bool sparse() const {
+            return m_header->layout == MODEL_SPARSE;
+        }
+        /*
+         * the number of weight columns, feature_size for a dense model
+         */
+        int column_cnt() const {
+            return sparse() ? m_header->column_cnt : feature_size();
+        }
+        /*
+         * the feature id of each column of a sparse model
+         */
+        const int32_t *ids() const {
+            return (const int32_t *)(m_file.data() + m_header->id_offset);
+        }
+        const void *weight() const {
+            return m_file.data() + m_header->weight_offset;
+        }
+        /*
+         * the column of feature id in a sparse model, -1 if it was
+         * pruned
+         */
+        int find(int id) const {
+            const int32_t *table =
+                (const int32_t *)(m_file.data() + m_header->table_offset);
+            const int32_t *col_id = ids();
+            int mask = (1 << m_header->table_bits) - 1;
+            int h = hash_feature(id, m_header->table_bits);
+            while (table[h] >= 0 && col_id[table[h]] != id) {
+                h = (h + 1) & mask;
+            }
+            return table[h];
+        }
+    private:
+        ModelFile(const ModelFile &);
+        ModelFile &operator=(const ModelFile &);
+
+        MappedFile m_file;
+        const ModelHeader *m_header;
+};
+
+#endif
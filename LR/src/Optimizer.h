@@ -0,0 +1,55 @@
+/*
+ * Optimizer.h
+ * The optimizers the training can use
+ */
+
+#ifndef OPTIMIZER_HEADER
+#define OPTIMIZER_HEADER
+
+#include <string>
+
+/*
+ * The update rule applied to the touched columns of w after each
+ * minibatch. All of them keep their per-weight state in arrays shared
+ * by the training threads, updated hogwild! style like w itself
+ *     OPT_SGD      momentum SGD, state: the momentum d
+ *     OPT_ADAGRAD  state: the sum of squared gradients
+ *     OPT_ADAM     state: the first and second moment
+ *     OPT_FTRL     FTRL-Proximal with L1 and L2, state: z and n
+ */
+enum Optimizer {
+    OPT_SGD,
+    OPT_ADAGRAD,
+    OPT_ADAM,
+    OPT_FTRL
+};
+
+#define ADAM_BETA1 0.9
+#define ADAM_BETA2 0.999
+// keeps the adaptive step sizes finite
+#define OPTIMIZER_EPS 1e-8
+
+inline Optimizer parse_optimizer(const std::string &name) {
+    if (name == "sgd") {
+        return OPT_SGD;
+    }
+    if (name == "adagrad") {
+        return OPT_ADAGRAD;
+    }
+    if (name == "adam") {
+        return OPT_ADAM;
+    }
+    if (name == "ftrl") {
+        return OPT_FTRL;
+    }
+    throw "unknown optimizer";
+}
+
+/*
+ * the number of state arrays of the size of w the optimizer keeps
+ */
+inline int optimizer_slots(Optimizer opt) {
+    return opt == OPT_ADAM || opt == OPT_FTRL ? 2 : 1;
+}
+
+#endif
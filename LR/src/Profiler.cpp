@@ -0,0 +1,98 @@
+/*
+ * Profiler.cpp
+ * The definition of class Profiler
+ */
+
+#include "Profiler.h"
+#include "Stopwatch.h"
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+static const char *PHASE_NAMES[PHASE_CNT] = {
+    "load", "shuffle", "gather", "forward", "gradient", "update", "eval"
+};
+
+Profiler::Profiler(int thread_cnt, const string &trace_filename) {
+    m_slots.resize(thread_cnt);
+    for (auto &s : m_slots) {
+        memset(&s.v, 0, sizeof(s.v));
+    }
+    m_trace = NULL;
+    m_json = false;
+    if (!trace_filename.empty()) {
+        m_trace = fopen(trace_filename.c_str(), "w");
+        if (m_trace == NULL) {
+            throw "cannot open profile trace file";
+        }
+        m_json = trace_filename.size() >= 5 && trace_filename.compare(
+                trace_filename.size() - 5, 5, ".json") == 0;
+        if (!m_json) {
+            fprintf(m_trace, "iter,phase,thread,wall,cpu\n");
+        }
+    }
+}
+
+Profiler::~Profiler() {
+    if (m_trace != NULL) {
+        fclose(m_trace);
+    }
+}
+
+void Profiler::start(int thread_id) {
+    Slot &s = m_slots[thread_id].v;
+    s.last_wall = wall_time();
+    s.last_cpu = thread_cpu_time();
+}
+
+void Profiler::lap(int thread_id, Phase phase) {
+    Slot &s = m_slots[thread_id].v;
+    double wall = wall_time();
+    double cpu = thread_cpu_time();
+    s.wall[phase] += wall - s.last_wall;
+    s.cpu[phase] += cpu - s.last_cpu;
+    s.last_wall = wall;
+    s.last_cpu = cpu;
+}
+
+string Profiler::report(int iter) {
+    string summary;
+    for (int p=0; p<PHASE_CNT; p++) {
+        double wall = 0;
+        double cpu = 0;
+        for (int t=0; t<(int)m_slots.size(); t++) {
+            const Slot &s = m_slots[t].v;
+            // the threads of a phase run side by side, its wall time is
+            // that of the slowest one
+            wall = max(wall, s.wall[p]);
+            cpu += s.cpu[p];
+            if (m_trace != NULL && s.wall[p] > 0) {
+                if (m_json) {
+                    fprintf(m_trace, "{\"iter\": %d, \"phase\": \"%s\", "
+                            "\"thread\": %d, \"wall\": %.6f, "
+                            "\"cpu\": %.6f}\n", iter, PHASE_NAMES[p], t,
+                            s.wall[p], s.cpu[p]);
+                }
+                else {
+                    fprintf(m_trace, "%d,%s,%d,%.6f,%.6f\n", iter,
+                            PHASE_NAMES[p], t, s.wall[p], s.cpu[p]);
+                }
+            }
+        }
+        if (wall > 0) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), " %s %.3f/%.3f", PHASE_NAMES[p],
+                    wall, cpu);
+            summary += buf;
+        }
+    }
+    if (m_trace != NULL) {
+        fflush(m_trace);
+    }
+    for (auto &s : m_slots) {
+        memset(s.v.wall, 0, sizeof(s.v.wall));
+        memset(s.v.cpu, 0, sizeof(s.v.cpu));
+    }
+    return summary;
+}
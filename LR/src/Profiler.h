@@ -0,0 +1,71 @@
+/*
+ * Profiler.h
+ * The declaration of class Profiler
+ */
+
+#ifndef PROFILER_HEADER
+#define PROFILER_HEADER
+
+#include "ThreadPool.h"
+#include <vector>
+#include <string>
+#include <cstdio>
+
+/*
+ * The phases of training and scoring the time is split into
+ */
+enum Phase {
+    PHASE_LOAD,
+    PHASE_SHUFFLE,
+    PHASE_GATHER,
+    PHASE_FORWARD,
+    PHASE_GRADIENT,
+    PHASE_UPDATE,
+    PHASE_EVAL,
+    PHASE_CNT
+};
+
+/*
+ * Wall and cpu time spent in each phase by each thread. A thread calls
+ * start() when it begins working and lap() at the end of each phase,
+ * which charges the time since its previous start() or lap() to the
+ * phase. Every thread only writes its own slot, so timing needs no
+ * synchronization. report() totals the phases, writes them to the trace
+ * and starts over
+ */
+class Profiler {
+    public:
+        /*
+         * slots for thread_cnt threads, and write the trace to
+         * trace_filename unless it is empty, as JSON lines when it
+         * ends with .json and as CSV else
+         */
+        Profiler(int thread_cnt, const std::string &trace_filename);
+        ~Profiler();
+
+        void start(int thread_id);
+        void lap(int thread_id, Phase phase);
+        /*
+         * format the wall seconds of each phase on its slowest thread
+         * and its cpu seconds summed over the threads for the log, add
+         * one trace record per thread and phase for iteration iter, and
+         * clear the times
+         */
+        std::string report(int iter);
+    private:
+        Profiler(const Profiler &);
+        Profiler &operator=(const Profiler &);
+
+        struct Slot {
+            double wall[PHASE_CNT];
+            double cpu[PHASE_CNT];
+            // the times at the last start() or lap()
+            double last_wall;
+            double last_cpu;
+        };
+        std::vector<Padded<Slot>> m_slots;
+        FILE *m_trace;
+        bool m_json;
+};
+
+#endif
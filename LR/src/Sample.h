@@ -8,11 +8,39 @@
 #include <vector>
 #include <algorithm>
 
-class Sample {
+/*
+ * one (feature id, value) pair exactly as stored in the .bin file,
+ * the feature id is 1-based
+ */
+struct RawFeat {
+    int id;
+    float value;
+};
+
+/*
+ * one (feature id, value) pair in memory, the feature id is 0-based
+ */
+struct Feat {
+    int id;
+    float value;
+};
+
+/*
+ * A sample that points into a mapped .bin file instead of owning
+ * its features. label is 0-based, use id() to get 0-based feature ids
+ */
+class SampleView {
     public:
         int label;
-        std::vector<std::pair<int, float>> feat;
+        int len;
+        const RawFeat *feat;
+
+        int id(int k) const {
+            return feat[k].id - 1;
+        }
+        float value(int k) const {
+            return feat[k].value;
+        }
 };
 
 #endif
-
@@ -0,0 +1,118 @@
+/*
+ * SampleFile.cpp
+ * The definition of class SampleFile
+ */
+
+#include "SampleFile.h"
+#include <cstring>
+#include <cstdio>
+#include <string>
+
+/*
+ * The header of the offset index sidecar, followed by count + 1
+ * offsets. file_size and mtime tell whether it still matches the file
+ */
+struct IndexHeader {
+    char magic[8];
+    unsigned long long file_size;
+    long long mtime;
+    unsigned long long count;
+};
+
+static const char INDEX_MAGIC[8] = "LRINDEX";
+
+SampleFile::SampleFile(const char *filename, bool use_index)
+    : m_file(filename) {
+    // the file is read front to back once to build the index
+    m_file.will_need();
+
+    long long mtime = m_file.mtime();
+    std::string index_filename = std::string(filename) + ".idx";
+    if (!use_index || !load_index(index_filename.c_str(), mtime)) {
+        index();
+        if (use_index) {
+            save_index(index_filename.c_str(), mtime);
+        }
+    }
+}
+
+SampleView SampleFile::sample(size_t i) const {
+    const size_t header = sizeof(int) * 2;
+    const char *p = m_file.data() + m_offsets[i];
+    int len;
+    int label;
+    memcpy(&len, p, sizeof(int));
+    memcpy(&label, p + sizeof(int), sizeof(int));
+    if ((size_t)len != m_offsets[i + 1] - m_offsets[i]) {
+        throw "corrupted sample file";
+    }
+    SampleView s;
+    s.label = label - 1;
+    s.len = len / sizeof(RawFeat) - 1;
+    s.feat = (const RawFeat *)(p + header);
+    return s;
+}
+
+void SampleFile::index() {
+    const size_t header = sizeof(int) * 2;
+    size_t i = 0;
+    m_offsets.clear();
+    while (i + header <= m_file.size()) {
+        int len;
+        memcpy(&len, m_file.data() + i, sizeof(int));
+        if (len < (int)header || len % sizeof(RawFeat) != 0 ||
+                i + len > m_file.size()) {
+            throw "corrupted sample file";
+        }
+        m_offsets.push_back(i);
+        i += len;
+    }
+    if (i != m_file.size()) {
+        throw "corrupted sample file";
+    }
+    m_offsets.push_back(i);
+}
+
+bool SampleFile::load_index(const char *filename, long long mtime) {
+    FILE *fi = fopen(filename, "rb");
+    if (fi == NULL) {
+        return false;
+    }
+    IndexHeader h;
+    bool ok = fread(&h, sizeof(h), 1, fi) == 1
+        && memcmp(h.magic, INDEX_MAGIC, sizeof(h.magic)) == 0
+        && h.file_size == m_file.size() && h.mtime == mtime
+        && h.count <= m_file.size() / sizeof(RawFeat);
+    if (ok) {
+        m_offsets.resize(h.count + 1);
+        ok = fread(m_offsets.data(), sizeof(size_t), h.count + 1, fi)
+            == h.count + 1;
+    }
+    fclose(fi);
+    // every record must hold at least its header, in whole features
+    for (size_t i=0; ok && i<h.count; i++) {
+        size_t len = m_offsets[i + 1] - m_offsets[i];
+        ok = m_offsets[i + 1] > m_offsets[i] && len % sizeof(RawFeat) == 0;
+    }
+    ok = ok && m_offsets[0] == 0 && m_offsets[h.count] == m_file.size();
+    if (!ok) {
+        m_offsets.clear();
+    }
+    return ok;
+}
+
+void SampleFile::save_index(const char *filename, long long mtime) {
+    IndexHeader h;
+    memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+    h.file_size = m_file.size();
+    h.mtime = mtime;
+    h.count = size();
+    // the sidecar only saves time, a directory that can not be
+    // written is no error
+    AtomicFile fo;
+    if (fo.open(filename)) {
+        fo.write(&h, sizeof(h));
+        fo.write(m_offsets.data(), sizeof(size_t) * m_offsets.size());
+        fo.commit();
+    }
+}
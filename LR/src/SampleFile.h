@@ -0,0 +1,65 @@
+/*
+ * SampleFile.h
+ * The declaration of class SampleFile
+ */
+
+#ifndef SAMPLE_FILE_HEADER
+#define SAMPLE_FILE_HEADER
+
+#include "Sample.h"
+#include "FileIO.h"
+#include <vector>
+#include <cstddef>
+
+/*
+ * A read-only memory mapping of a .bin feature file.
+ * Each record is laid out as
+ *     int len; int label; RawFeat feat[len / 8 - 1];
+ * where len is the size of the whole record in bytes.
+ * The samples are views into the mapping, so they are only valid
+ * while the SampleFile is alive
+ */
+class SampleFile {
+    public:
+        /*
+         * map the file and index the records, throw on failure.
+         * With use_index the record offsets are read from the sidecar
+         * file filename.idx if it matches the file, else they are
+         * found by walking the records and saved to the sidecar
+         */
+        SampleFile(const char *filename, bool use_index = false);
+
+        size_t size() const {
+            return m_offsets.size() - 1;
+        }
+        /*
+         * the byte offset of record i, offset(size()) is the file size
+         */
+        size_t offset(size_t i) const {
+            return m_offsets[i];
+        }
+        /*
+         * record i, whose len field is checked against the index
+         */
+        SampleView sample(size_t i) const;
+    private:
+        SampleFile(const SampleFile &);
+        SampleFile &operator=(const SampleFile &);
+
+        /*
+         * walk the records and build the offset index
+         */
+        void index();
+        /*
+         * read the offset index from or write it to the sidecar file,
+         * which carries the size and modification time of the file
+         * it indexes. load returns false if it is missing or stale
+         */
+        bool load_index(const char *filename, long long mtime);
+        void save_index(const char *filename, long long mtime);
+
+        MappedFile m_file;
+        std::vector<size_t> m_offsets;
+};
+
+#endif
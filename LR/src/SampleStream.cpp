@@ -0,0 +1,186 @@
+/*
+ * SampleStream.cpp
+ * The definition of class SampleStream
+ */
+
+#include "SampleStream.h"
+#include "CompactFile.h"
+#include <cstring>
+
+using namespace std;
+
+SampleStream::SampleStream(const char *filename, size_t chunk_bytes) {
+    if (is_compact_file(filename)) {
+        throw "stream mode reads only the .bin format";
+    }
+    m_file = fopen(filename, "rb");
+    if (m_file == NULL) {
+        throw "cannot open sample file";
+    }
+    // a pass over an empty file would end before it starts, forever
+    if (fgetc(m_file) == EOF) {
+        fclose(m_file);
+        throw "empty sample file";
+    }
+    rewind(m_file);
+    m_chunk_bytes = chunk_bytes;
+    m_buf.resize(chunk_bytes);
+    m_begin = 0;
+    m_end = 0;
+    m_error = NULL;
+    m_stop = false;
+    m_end_pending = false;
+    // one chunk is trained on while the other one is filled
+    for (int i=0; i<2; i++) {
+        m_chunks.push_back(new Dataset());
+        m_free.push_back(m_chunks[i]);
+    }
+    m_thread = thread(&SampleStream::prefetch, this);
+}
+
+SampleStream::~SampleStream() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+    for (auto c : m_chunks) {
+        delete c;
+    }
+    fclose(m_file);
+}
+
+Dataset *SampleStream::next() {
+    unique_lock<mutex> lock(m_mutex);
+    while (m_ready.empty() && m_error == NULL) {
+        m_cond.wait(lock);
+    }
+    if (m_error != NULL) {
+        throw m_error;
+    }
+    Dataset *chunk = m_ready.front();
+    m_ready.pop_front();
+    if (chunk == NULL) {
+        // the prefetch thread may start the next pass
+        m_end_pending = false;
+        lock.unlock();
+        m_cond.notify_all();
+    }
+    return chunk;
+}
+
+void SampleStream::release(Dataset *chunk) {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_free.push_back(chunk);
+    }
+    m_cond.notify_all();
+}
+
+void SampleStream::prefetch() {
+    try {
+        while (true) {
+            Dataset *chunk;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                while (m_free.empty() && !m_stop) {
+                    m_cond.wait(lock);
+                }
+                if (m_stop) {
+                    return;
+                }
+                chunk = m_free.back();
+                m_free.pop_back();
+            }
+            // parse outside the lock, this is the work that overlaps
+            // with training
+            bool more = read_chunk(chunk);
+            {
+                lock_guard<mutex> lock(m_mutex);
+                if (more) {
+                    m_ready.push_back(chunk);
+                }
+                else {
+                    m_free.push_back(chunk);
+                    m_ready.push_back(NULL);
+                    m_end_pending = true;
+                }
+            }
+            m_cond.notify_all();
+            if (!more) {
+                // start the next pass once the consumer reached the end
+                // of this one, so there is one end marker at a time
+                rewind(m_file);
+                m_begin = 0;
+                m_end = 0;
+                unique_lock<mutex> lock(m_mutex);
+                while (m_end_pending && !m_stop) {
+                    m_cond.wait(lock);
+                }
+            }
+        }
+    }
+    catch (const char *e) {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_error = e;
+        }
+        m_cond.notify_all();
+    }
+}
+
+bool SampleStream::fill(size_t need) {
+    if (m_end - m_begin >= need) {
+        return true;
+    }
+    memmove(m_buf.data(), m_buf.data() + m_begin, m_end - m_begin);
+    m_end -= m_begin;
+    m_begin = 0;
+    if (m_buf.size() < need) {
+        // a record larger than the buffer
+        m_buf.resize(need);
+    }
+    while (m_end < need) {
+        size_t n = fread(m_buf.data() + m_end, 1, m_buf.size() - m_end,
+                m_file);
+        if (n == 0) {
+            return false;
+        }
+        m_end += n;
+    }
+    return true;
+}
+
+bool SampleStream::read_chunk(Dataset *chunk) {
+    const size_t header = sizeof(int) * 2;
+    chunk->clear();
+    size_t used = 0;
+    while (used < m_chunk_bytes) {
+        if (!fill(header)) {
+            break;
+        }
+        int len;
+        int label;
+        memcpy(&len, m_buf.data() + m_begin, sizeof(int));
+        memcpy(&label, m_buf.data() + m_begin + sizeof(int), sizeof(int));
+        if (len < (int)header || len % sizeof(RawFeat) != 0 ||
+                !fill(len)) {
+            throw "corrupted sample file";
+        }
+
+        SampleView s;
+        s.label = label - 1;
+        s.len = len / sizeof(RawFeat) - 1;
+        s.feat = (const RawFeat *)(m_buf.data() + m_begin + header);
+        chunk->append(s);
+
+        m_begin += len;
+        used += len;
+    }
+    if (used < m_chunk_bytes && m_begin != m_end) {
+        // the file ends inside a record
+        throw "corrupted sample file";
+    }
+    return chunk->size() > 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * SampleStream.h
+ * The declaration of class SampleStream
+ */
+
+#ifndef SAMPLE_STREAM_HEADER
+#define SAMPLE_STREAM_HEADER
+
+#include "Dataset.h"
+#include <cstdio>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+ * Reads a .bin feature file in chunks of about chunk_bytes on a
+ * prefetch thread, so at most two chunks are in memory and the next
+ * chunk is parsed while the current one is trained on. The file is
+ * read over and over, one pass after the other
+ */
+class SampleStream {
+    public:
+        /*
+         * throw if the file can not be opened or holds no samples
+         */
+        SampleStream(const char *filename, size_t chunk_bytes);
+        ~SampleStream();
+
+        /*
+         * the next chunk of the current pass, NULL at the end of the
+         * pass, the call after that starts the next pass.
+         * throw if the file can not be read
+         */
+        Dataset *next();
+        /*
+         * give a chunk returned by next() back for reuse
+         */
+        void release(Dataset *chunk);
+    private:
+        SampleStream(const SampleStream &);
+        SampleStream &operator=(const SampleStream &);
+
+        /*
+         * the body of the prefetch thread
+         */
+        void prefetch();
+        /*
+         * parse about m_chunk_bytes of records into chunk,
+         * return false at the end of the file
+         */
+        bool read_chunk(Dataset *chunk);
+        /*
+         * make at least need bytes available in the read buffer,
+         * return false if the file ends before that
+         */
+        bool fill(size_t need);
+
+        FILE *m_file;
+        size_t m_chunk_bytes;
+        // unparsed bytes are m_buf[m_begin, m_end)
+        std::vector<char> m_buf;
+        size_t m_begin;
+        size_t m_end;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        // parsed chunks in file order, NULL marks the end of a pass
+        std::deque<Dataset*> m_ready;
+        std::vector<Dataset*> m_free;
+        std::vector<Dataset*> m_chunks;
+        const char *m_error;
+        bool m_stop;
+        // an end marker is in m_ready, not yet taken by next()
+        bool m_end_pending;
+        std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,255 @@
+/*
+ * Server.cpp
+ * The main functions of the scoring server
+ *
+ * The server loads the model saved by main and answers requests read
+ * from stdin, or from every connection to a unix socket when
+ * server_socket is set. A request is one record of the .bin format,
+ *     int len; int label; RawFeat feat[len / 8 - 1];
+ * with the label ignored, and the answer is one line
+ *     class expectation
+ * as in the result files of main. Answers are in request order
+ */
+#include "LR.h"
+#include "Batcher.h"
+#include "Log.h"
+#include "Softmax.h"
+#include <deque>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <climits>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+Config cfg;
+
+using namespace std;
+
+// most requests of one connection read ahead of their answers
+#define MAX_PENDING 1024
+// longest accepted request in bytes
+#define MAX_REQUEST (8 << 20)
+// seconds between two latency reports of the socket server
+#define REPORT_INTERVAL 10
+
+/*
+ * One client. A reader thread submits the requests as they arrive so
+ * pipelined requests of the same client share batches, and the
+ * serving thread writes the answers in order
+ */
+class Connection {
+    public:
+        Connection(FILE *in, FILE *out, Batcher *batcher) {
+            m_in = in;
+            m_out = out;
+            m_batcher = batcher;
+            m_eof = false;
+        }
+
+        /*
+         * answer requests until the input ends or is malformed
+         */
+        void serve() {
+            thread reader(&Connection::read_loop, this);
+            while (true) {
+                unique_lock<mutex> lock(m_mutex);
+                m_cond.wait(lock, [this] {
+                    return (!m_pending.empty() && m_pending.front()->done)
+                        || (m_eof && m_pending.empty());
+                });
+                if (m_pending.empty()) {
+                    break;
+                }
+                Request *req = m_pending.front();
+                m_pending.pop_front();
+                bool more = !m_pending.empty() && m_pending.front()->done;
+                lock.unlock();
+                m_cond.notify_all();
+
+                fprintf(m_out, "%d %.8f\n", req->result.first + 1,
+                        req->result.second + 1);
+                // answers ready together leave in one write
+                if (!more) {
+                    fflush(m_out);
+                }
+                delete req;
+            }
+            fflush(m_out);
+            reader.join();
+        }
+    private:
+        void read_loop() {
+            while (true) {
+                Request *req = new Request();
+                if (!read_request(req)) {
+                    delete req;
+                    break;
+                }
+                req->done = false;
+                req->mutex = &m_mutex;
+                req->cond = &m_cond;
+                {
+                    unique_lock<mutex> lock(m_mutex);
+                    m_cond.wait(lock, [this] {
+                        return m_pending.size() < MAX_PENDING;
+                    });
+                    m_pending.push_back(req);
+                }
+                m_batcher->submit(req);
+            }
+            {
+                lock_guard<mutex> lock(m_mutex);
+                m_eof = true;
+            }
+            m_cond.notify_all();
+        }
+
+        /*
+         * read one record, false at the end of the input or on a
+         * malformed record
+         */
+        bool read_request(Request *req) {
+            int header[2];
+            if (fread(header, sizeof(header), 1, m_in) != 1) {
+                return false;
+            }
+            int len = header[0];
+            if (len < (int)sizeof(header) || len % sizeof(RawFeat) != 0
+                    || len > MAX_REQUEST) {
+                LOG("malformed request of %d bytes\n", len);
+                return false;
+            }
+            req->feat.resize(len / sizeof(RawFeat) - 1);
+            if (!req->feat.empty() && fread(req->feat.data(),
+                        sizeof(RawFeat) * req->feat.size(), 1, m_in) != 1) {
+                return false;
+            }
+            // any id is fine when it is hashed into the buckets
+            int max_id = cfg.hash_bits > 0 ? INT_MAX : cfg.feature_size;
+            for (const RawFeat &f : req->feat) {
+                if (f.id < 1 || f.id > max_id) {
+                    LOG("feature id %d out of range\n", f.id);
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        FILE *m_in;
+        FILE *m_out;
+        Batcher *m_batcher;
+
+        // guards m_pending, m_eof and done of the pending requests
+        mutex m_mutex;
+        condition_variable m_cond;
+        deque<Request *> m_pending;
+        bool m_eof;
+};
+
+/*
+ * serve every connection to the unix socket at path on its own thread
+ */
+void listen_socket(const string &path, Batcher *batcher) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw "cannot create socket";
+    }
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw "socket path too long";
+    }
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+        throw "cannot listen on socket";
+    }
+    LOG("listen on %s\n", path.c_str());
+    // a client leaving early must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    thread([batcher] {
+        while (true) {
+            this_thread::sleep_for(chrono::seconds(REPORT_INTERVAL));
+            batcher->report();
+        }
+    }).detach();
+
+    while (true) {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        thread([client, batcher] {
+            FILE *in = fdopen(client, "r");
+            FILE *out = fdopen(dup(client), "w");
+            Connection conn(in, out, batcher);
+            conn.serve();
+            fclose(in);
+            fclose(out);
+        }).detach();
+    }
+}
+
+/*
+ * load the model with scalar type Real and serve requests until stdin
+ * ends, or forever on a socket
+ */
+template <typename Real>
+void serve() {
+    // requests are scored on the batcher thread, no pool is needed
+    Config model_cfg = cfg;
+    model_cfg.thread_cnt = 1;
+    LR<Real> lr(model_cfg);
+    lr.load(cfg.model_filename.c_str());
+
+    Batcher batcher([&lr](Dataset &batch,
+                vector<pair<int, double>> &pred) {
+            lr.score(batch, pred);
+        }, cfg.server_batch, cfg.server_wait);
+
+    if (cfg.server_socket.empty()) {
+        Connection conn(stdin, stdout, &batcher);
+        conn.serve();
+        batcher.report();
+    }
+    else {
+        listen_socket(cfg.server_socket, &batcher);
+    }
+}
+
+/*
+ * The main routine
+ */
+int main(int argc, char **argv) {
+
+    if (argc < 2) {
+        printf("usage: ./server cfg.txt < requests\n");
+        return 0;
+    }
+
+    cfg.parse(argv[1]);
+
+    // stdout carries the answers, logs go to stderr
+    Log::initialize("server_log.txt", stderr);
+    softmax_select(cfg.simd);
+
+    if (cfg.precision == "double") {
+        serve<double>();
+    }
+    else if (cfg.precision == "float") {
+        serve<float>();
+    }
+    else {
+        throw "unknown precision";
+    }
+
+    Log::close();
+
+    return 0;
+}
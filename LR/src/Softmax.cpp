@@ -0,0 +1,485 @@
+/*
+ * Softmax.cpp
+ * The definition of the vectorized softmax, with an AVX-512 and an AVX2
+ * version selected at runtime and a scalar fallback, each in double
+ * and single precision
+ */
+
+#include "Softmax.h"
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <immintrin.h>
+
+// gcc's AVX-512 intrinsics start from _mm512_undefined_pd(), which its
+// own uninitialized-use analysis reports as a false positive
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+using namespace std;
+
+/*
+ * exp(x) = 2^n * exp(r), r = x - n * ln2 in [-ln2/2, ln2/2], exp(r) by
+ * its Taylor series up to r^11 (relative error below 1e-15)
+ */
+#define LN2_HI 6.93145751953125e-1
+#define LN2_LO 1.42860682030941723212e-6
+#define LOG2E 1.4426950408889634074
+#define EXP_MIN -700.0
+#define EXP_MAX 700.0
+
+static const double EXP_POLY[] = {
+    1.0 / 39916800, 1.0 / 3628800, 1.0 / 362880, 1.0 / 40320,
+    1.0 / 5040, 1.0 / 720, 1.0 / 120, 1.0 / 24, 1.0 / 6, 1.0 / 2, 1.0, 1.0
+};
+
+// the single precision constants, exp(r) up to r^7
+#define LN2_HI_F 6.93359375e-1f
+#define LN2_LO_F -2.12194440e-4f
+#define EXP_MIN_F -87.0f
+#define EXP_MAX_F 87.0f
+#define EXP_TERMS_F 8
+
+/*
+ * log(x) = e * ln2 + log(m), x = m * 2^e with m in [sqrt(1/2), sqrt(2)),
+ * log(m) = 2 atanh(s), s = (m - 1) / (m + 1), |s| < 0.172
+ */
+#define SQRT2 1.41421356237309504880
+#define LN2 6.93147180559945309417e-1
+#define LOG_TERMS 10
+#define LOG_TERMS_F 5
+
+typedef double (*SoftmaxFunc)(double *, int, int, int, const int *);
+typedef double (*SoftmaxFuncF)(float *, int, int, int, const int *);
+
+template <typename Real>
+static double softmax_scalar(Real *y, int classes, int n, int ld,
+        const int *label) {
+    double l = 0;
+    for (int i=0; i<n; i++) {
+        Real maxv = y[i];
+        for (int c=1; c<classes; c++) {
+            maxv = max(maxv, y[c * ld + i]);
+        }
+        // log p = z - log(sum), which does not underflow like p does
+        Real z = label == NULL ? 0 : y[label[i] * ld + i] - maxv;
+        Real v = 0;
+        for (int c=0; c<classes; c++) {
+            Real e = exp(y[c * ld + i] - maxv);
+            y[c * ld + i] = e;
+            v += e;
+        }
+        if (label != NULL) {
+            l += z - log(v);
+        }
+        for (int c=0; c<classes; c++) {
+            y[c * ld + i] /= v;
+        }
+    }
+    return l;
+}
+
+/*
+ * AVX2, 4 samples per vector
+ */
+
+__attribute__((target("avx2,fma")))
+static inline __m256d exp_avx2(__m256d x) {
+    x = _mm256_min_pd(_mm256_max_pd(x, _mm256_set1_pd(EXP_MIN)),
+            _mm256_set1_pd(EXP_MAX));
+    __m256d n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(LOG2E)),
+            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_HI), x);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_LO), r);
+    __m256d p = _mm256_set1_pd(EXP_POLY[0]);
+    for (int i=1; i<12; i++) {
+        p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_POLY[i]));
+    }
+    __m256i e = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+    e = _mm256_slli_epi64(_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52);
+    return _mm256_mul_pd(p, _mm256_castsi256_pd(e));
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256d log_avx2(__m256d x) {
+    __m256i bits = _mm256_castpd_si256(x);
+    __m256i e = _mm256_sub_epi64(_mm256_srli_epi64(bits, 52),
+            _mm256_set1_epi64x(1023));
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(
+                _mm256_and_si256(bits, _mm256_set1_epi64x(0xfffffffffffffLL)),
+                _mm256_set1_epi64x(0x3ff0000000000000LL)));
+    // bring m into [sqrt(1/2), sqrt(2))
+    __m256d big = _mm256_cmp_pd(m, _mm256_set1_pd(SQRT2), _CMP_GE_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+    e = _mm256_sub_epi64(e, _mm256_castpd_si256(big));
+    // the exponent is small, so its low 32 bits convert exactly
+    __m256d ef = _mm256_cvtepi32_pd(_mm256_castsi256_si128(
+                _mm256_permutevar8x32_epi32(e,
+                    _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7))));
+    __m256d one = _mm256_set1_pd(1.0);
+    __m256d s = _mm256_div_pd(_mm256_sub_pd(m, one), _mm256_add_pd(m, one));
+    __m256d s2 = _mm256_mul_pd(s, s);
+    __m256d p = _mm256_set1_pd(1.0 / (2 * LOG_TERMS + 1));
+    for (int i=LOG_TERMS-1; i>=0; i--) {
+        p = _mm256_fmadd_pd(p, s2, _mm256_set1_pd(1.0 / (2 * i + 1)));
+    }
+    return _mm256_fmadd_pd(ef, _mm256_set1_pd(LN2),
+            _mm256_mul_pd(_mm256_set1_pd(2.0), _mm256_mul_pd(p, s)));
+}
+
+__attribute__((target("avx2,fma")))
+static double softmax_avx2(double *y, int classes, int n, int ld,
+        const int *label) {
+    __m256d l = _mm256_setzero_pd();
+    int i = 0;
+    for (; i+4<=n; i+=4) {
+        __m256d maxv = _mm256_loadu_pd(y + i);
+        for (int c=1; c<classes; c++) {
+            maxv = _mm256_max_pd(maxv, _mm256_loadu_pd(y + c * ld + i));
+        }
+        __m256i lab = _mm256_setzero_si256();
+        if (label != NULL) {
+            lab = _mm256_cvtepi32_epi64(
+                    _mm_loadu_si128((const __m128i *)(label + i)));
+        }
+        __m256d v = _mm256_setzero_pd();
+        __m256d t = _mm256_setzero_pd();
+        for (int c=0; c<classes; c++) {
+            __m256d z = _mm256_sub_pd(_mm256_loadu_pd(y + c * ld + i), maxv);
+            __m256d mask = _mm256_castsi256_pd(
+                    _mm256_cmpeq_epi64(lab, _mm256_set1_epi64x(c)));
+            t = _mm256_blendv_pd(t, z, mask);
+            z = exp_avx2(z);
+            _mm256_storeu_pd(y + c * ld + i, z);
+            v = _mm256_add_pd(v, z);
+        }
+        if (label != NULL) {
+            l = _mm256_add_pd(l, _mm256_sub_pd(t, log_avx2(v)));
+        }
+        __m256d inv = _mm256_div_pd(_mm256_set1_pd(1.0), v);
+        for (int c=0; c<classes; c++) {
+            _mm256_storeu_pd(y + c * ld + i,
+                    _mm256_mul_pd(_mm256_loadu_pd(y + c * ld + i), inv));
+        }
+    }
+    double buf[4];
+    _mm256_storeu_pd(buf, l);
+    double ret = buf[0] + buf[1] + buf[2] + buf[3];
+    if (i < n) {
+        ret += softmax_scalar(y + i, classes, n - i, ld,
+                label == NULL ? NULL : label + i);
+    }
+    return ret;
+}
+
+/*
+ * AVX2 single precision, 8 samples per vector
+ */
+
+__attribute__((target("avx2,fma")))
+static inline __m256 exp_avx2(__m256 x) {
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(EXP_MIN_F)),
+            _mm256_set1_ps(EXP_MAX_F));
+    __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(LOG2E)),
+            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(LN2_HI_F), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(LN2_LO_F), r);
+    __m256 p = _mm256_set1_ps(EXP_POLY[12 - EXP_TERMS_F]);
+    for (int i=13-EXP_TERMS_F; i<12; i++) {
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_POLY[i]));
+    }
+    __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n),
+                _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 log_avx2(__m256 x) {
+    __m256i bits = _mm256_castps_si256(x);
+    __m256i e = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23),
+            _mm256_set1_epi32(127));
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(
+                _mm256_and_si256(bits, _mm256_set1_epi32(0x7fffff)),
+                _mm256_set1_epi32(0x3f800000)));
+    __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps(SQRT2), _CMP_GE_OQ);
+    m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+    e = _mm256_sub_epi32(e, _mm256_castps_si256(big));
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 s = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+    __m256 s2 = _mm256_mul_ps(s, s);
+    __m256 p = _mm256_set1_ps(1.0f / (2 * LOG_TERMS_F + 1));
+    for (int i=LOG_TERMS_F-1; i>=0; i--) {
+        p = _mm256_fmadd_ps(p, s2, _mm256_set1_ps(1.0f / (2 * i + 1)));
+    }
+    return _mm256_fmadd_ps(_mm256_cvtepi32_ps(e), _mm256_set1_ps(LN2),
+            _mm256_mul_ps(_mm256_set1_ps(2.0f), _mm256_mul_ps(p, s)));
+}
+
+__attribute__((target("avx2,fma")))
+static double softmax_avx2(float *y, int classes, int n, int ld,
+        const int *label) {
+    double l = 0;
+    int i = 0;
+    for (; i+8<=n; i+=8) {
+        __m256 maxv = _mm256_loadu_ps(y + i);
+        for (int c=1; c<classes; c++) {
+            maxv = _mm256_max_ps(maxv, _mm256_loadu_ps(y + c * ld + i));
+        }
+        __m256i lab = _mm256_setzero_si256();
+        if (label != NULL) {
+            lab = _mm256_loadu_si256((const __m256i *)(label + i));
+        }
+        __m256 v = _mm256_setzero_ps();
+        __m256 t = _mm256_setzero_ps();
+        for (int c=0; c<classes; c++) {
+            __m256 z = _mm256_sub_ps(_mm256_loadu_ps(y + c * ld + i), maxv);
+            __m256 mask = _mm256_castsi256_ps(
+                    _mm256_cmpeq_epi32(lab, _mm256_set1_epi32(c)));
+            t = _mm256_blendv_ps(t, z, mask);
+            z = exp_avx2(z);
+            _mm256_storeu_ps(y + c * ld + i, z);
+            v = _mm256_add_ps(v, z);
+        }
+        if (label != NULL) {
+            // accumulate in double, a batch sums thousands of terms
+            float buf[8];
+            _mm256_storeu_ps(buf, _mm256_sub_ps(t, log_avx2(v)));
+            for (int k=0; k<8; k++) {
+                l += buf[k];
+            }
+        }
+        __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), v);
+        for (int c=0; c<classes; c++) {
+            _mm256_storeu_ps(y + c * ld + i,
+                    _mm256_mul_ps(_mm256_loadu_ps(y + c * ld + i), inv));
+        }
+    }
+    if (i < n) {
+        l += softmax_scalar(y + i, classes, n - i, ld,
+                label == NULL ? NULL : label + i);
+    }
+    return l;
+}
+
+/*
+ * AVX-512, 8 samples per vector
+ */
+
+__attribute__((target("avx512f")))
+static inline __m512d exp_avx512(__m512d x) {
+    x = _mm512_min_pd(_mm512_max_pd(x, _mm512_set1_pd(EXP_MIN)),
+            _mm512_set1_pd(EXP_MAX));
+    __m512d n = _mm512_roundscale_pd(
+            _mm512_mul_pd(x, _mm512_set1_pd(LOG2E)),
+            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512d r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_HI), x);
+    r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_LO), r);
+    __m512d p = _mm512_set1_pd(EXP_POLY[0]);
+    for (int i=1; i<12; i++) {
+        p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_POLY[i]));
+    }
+    // p * 2^n without building the exponent bits by hand
+    return _mm512_scalef_pd(p, n);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d log_avx512(__m512d x) {
+    // x = m * 2^e with m in [1, 2)
+    __m512d m = _mm512_getmant_pd(x, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_src);
+    __m512d e = _mm512_getexp_pd(x);
+    __mmask8 big = _mm512_cmp_pd_mask(m, _mm512_set1_pd(SQRT2), _CMP_GE_OQ);
+    m = _mm512_mask_mul_pd(m, big, m, _mm512_set1_pd(0.5));
+    e = _mm512_mask_add_pd(e, big, e, _mm512_set1_pd(1.0));
+    __m512d one = _mm512_set1_pd(1.0);
+    __m512d s = _mm512_div_pd(_mm512_sub_pd(m, one), _mm512_add_pd(m, one));
+    __m512d s2 = _mm512_mul_pd(s, s);
+    __m512d p = _mm512_set1_pd(1.0 / (2 * LOG_TERMS + 1));
+    for (int i=LOG_TERMS-1; i>=0; i--) {
+        p = _mm512_fmadd_pd(p, s2, _mm512_set1_pd(1.0 / (2 * i + 1)));
+    }
+    return _mm512_fmadd_pd(e, _mm512_set1_pd(LN2),
+            _mm512_mul_pd(_mm512_set1_pd(2.0), _mm512_mul_pd(p, s)));
+}
+
+__attribute__((target("avx512f")))
+static double softmax_avx512(double *y, int classes, int n, int ld,
+        const int *label) {
+    __m512d l = _mm512_setzero_pd();
+    int i = 0;
+    for (; i+8<=n; i+=8) {
+        __m512d maxv = _mm512_loadu_pd(y + i);
+        for (int c=1; c<classes; c++) {
+            maxv = _mm512_max_pd(maxv, _mm512_loadu_pd(y + c * ld + i));
+        }
+        __m256i lab = _mm256_setzero_si256();
+        if (label != NULL) {
+            lab = _mm256_loadu_si256((const __m256i *)(label + i));
+        }
+        __m512d v = _mm512_setzero_pd();
+        __m512d t = _mm512_setzero_pd();
+        for (int c=0; c<classes; c++) {
+            __m512d z = _mm512_sub_pd(_mm512_loadu_pd(y + c * ld + i), maxv);
+            __mmask8 mask = _mm512_cmpeq_epi64_mask(
+                    _mm512_cvtepi32_epi64(lab), _mm512_set1_epi64(c));
+            t = _mm512_mask_mov_pd(t, mask, z);
+            z = exp_avx512(z);
+            _mm512_storeu_pd(y + c * ld + i, z);
+            v = _mm512_add_pd(v, z);
+        }
+        if (label != NULL) {
+            l = _mm512_add_pd(l, _mm512_sub_pd(t, log_avx512(v)));
+        }
+        __m512d inv = _mm512_div_pd(_mm512_set1_pd(1.0), v);
+        for (int c=0; c<classes; c++) {
+            _mm512_storeu_pd(y + c * ld + i,
+                    _mm512_mul_pd(_mm512_loadu_pd(y + c * ld + i), inv));
+        }
+    }
+    double ret = _mm512_reduce_add_pd(l);
+    if (i < n) {
+        ret += softmax_scalar(y + i, classes, n - i, ld,
+                label == NULL ? NULL : label + i);
+    }
+    return ret;
+}
+
+/*
+ * AVX-512 single precision, 16 samples per vector
+ */
+
+__attribute__((target("avx512f")))
+static inline __m512 exp_avx512(__m512 x) {
+    x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(EXP_MIN_F)),
+            _mm512_set1_ps(EXP_MAX_F));
+    __m512 n = _mm512_roundscale_ps(
+            _mm512_mul_ps(x, _mm512_set1_ps(LOG2E)),
+            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(LN2_HI_F), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(LN2_LO_F), r);
+    __m512 p = _mm512_set1_ps(EXP_POLY[12 - EXP_TERMS_F]);
+    for (int i=13-EXP_TERMS_F; i<12; i++) {
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_POLY[i]));
+    }
+    return _mm512_scalef_ps(p, n);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 log_avx512(__m512 x) {
+    __m512 m = _mm512_getmant_ps(x, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_src);
+    __m512 e = _mm512_getexp_ps(x);
+    __mmask16 big = _mm512_cmp_ps_mask(m, _mm512_set1_ps(SQRT2), _CMP_GE_OQ);
+    m = _mm512_mask_mul_ps(m, big, m, _mm512_set1_ps(0.5f));
+    e = _mm512_mask_add_ps(e, big, e, _mm512_set1_ps(1.0f));
+    __m512 one = _mm512_set1_ps(1.0f);
+    __m512 s = _mm512_div_ps(_mm512_sub_ps(m, one), _mm512_add_ps(m, one));
+    __m512 s2 = _mm512_mul_ps(s, s);
+    __m512 p = _mm512_set1_ps(1.0f / (2 * LOG_TERMS_F + 1));
+    for (int i=LOG_TERMS_F-1; i>=0; i--) {
+        p = _mm512_fmadd_ps(p, s2, _mm512_set1_ps(1.0f / (2 * i + 1)));
+    }
+    return _mm512_fmadd_ps(e, _mm512_set1_ps(LN2),
+            _mm512_mul_ps(_mm512_set1_ps(2.0f), _mm512_mul_ps(p, s)));
+}
+
+__attribute__((target("avx512f")))
+static double softmax_avx512(float *y, int classes, int n, int ld,
+        const int *label) {
+    double l = 0;
+    int i = 0;
+    for (; i+16<=n; i+=16) {
+        __m512 maxv = _mm512_loadu_ps(y + i);
+        for (int c=1; c<classes; c++) {
+            maxv = _mm512_max_ps(maxv, _mm512_loadu_ps(y + c * ld + i));
+        }
+        __m512i lab = _mm512_setzero_si512();
+        if (label != NULL) {
+            lab = _mm512_loadu_si512(label + i);
+        }
+        __m512 v = _mm512_setzero_ps();
+        __m512 t = _mm512_setzero_ps();
+        for (int c=0; c<classes; c++) {
+            __m512 z = _mm512_sub_ps(_mm512_loadu_ps(y + c * ld + i), maxv);
+            __mmask16 mask = _mm512_cmpeq_epi32_mask(lab,
+                    _mm512_set1_epi32(c));
+            t = _mm512_mask_mov_ps(t, mask, z);
+            z = exp_avx512(z);
+            _mm512_storeu_ps(y + c * ld + i, z);
+            v = _mm512_add_ps(v, z);
+        }
+        if (label != NULL) {
+            // accumulate in double, a batch sums thousands of terms
+            __m512 d = _mm512_sub_ps(t, log_avx512(v));
+            l += _mm512_reduce_add_pd(_mm512_cvtps_pd(
+                        _mm512_castps512_ps256(d)));
+            l += _mm512_reduce_add_pd(_mm512_cvtps_pd(_mm256_castpd_ps(
+                            _mm512_extractf64x4_pd(_mm512_castps_pd(d), 1))));
+        }
+        __m512 inv = _mm512_div_ps(_mm512_set1_ps(1.0f), v);
+        for (int c=0; c<classes; c++) {
+            _mm512_storeu_ps(y + c * ld + i,
+                    _mm512_mul_ps(_mm512_loadu_ps(y + c * ld + i), inv));
+        }
+    }
+    if (i < n) {
+        l += softmax_scalar(y + i, classes, n - i, ld,
+                label == NULL ? NULL : label + i);
+    }
+    return l;
+}
+
+/*
+ * The chosen implementation, read by every training thread. Atomic so
+ * a selection racing with them, or the lazy "auto" one of two threads,
+ * is no data race. Relaxed is enough, the functions are static code
+ */
+static atomic<SoftmaxFunc> softmax_impl(NULL);
+static atomic<SoftmaxFuncF> softmax_impl_f(NULL);
+static atomic<const char *> softmax_impl_name(NULL);
+
+const char *softmax_select(const string &isa) {
+    __builtin_cpu_init();
+    bool avx512 = __builtin_cpu_supports("avx512f");
+    bool avx2 = __builtin_cpu_supports("avx2") &&
+        __builtin_cpu_supports("fma");
+    const char *name;
+    if ((isa == "auto" || isa == "avx512") && avx512) {
+        softmax_impl.store(softmax_avx512, memory_order_relaxed);
+        softmax_impl_f.store(softmax_avx512, memory_order_relaxed);
+        name = "avx512";
+    }
+    else if ((isa == "auto" || isa == "avx512" || isa == "avx2") && avx2) {
+        softmax_impl.store(softmax_avx2, memory_order_relaxed);
+        softmax_impl_f.store(softmax_avx2, memory_order_relaxed);
+        name = "avx2";
+    }
+    else {
+        softmax_impl.store(softmax_scalar<double>, memory_order_relaxed);
+        softmax_impl_f.store(softmax_scalar<float>, memory_order_relaxed);
+        name = "scalar";
+    }
+    softmax_impl_name.store(name, memory_order_relaxed);
+    return name;
+}
+
+const char *softmax_selected() {
+    const char *name = softmax_impl_name.load(memory_order_relaxed);
+    return name != NULL ? name : softmax_select("auto");
+}
+
+double softmax(double *y, int classes, int n, int ld, const int *label) {
+    SoftmaxFunc f = softmax_impl.load(memory_order_relaxed);
+    if (f == NULL) {
+        softmax_select("auto");
+        f = softmax_impl.load(memory_order_relaxed);
+    }
+    return f(y, classes, n, ld, label);
+}
+
+double softmax(float *y, int classes, int n, int ld, const int *label) {
+    SoftmaxFuncF f = softmax_impl_f.load(memory_order_relaxed);
+    if (f == NULL) {
+        softmax_select("auto");
+        f = softmax_impl_f.load(memory_order_relaxed);
+    }
+    return f(y, classes, n, ld, label);
+}
@@ -0,0 +1,36 @@
+/*
+ * Softmax.h
+ * The declaration of the vectorized softmax
+ */
+
+#ifndef SOFTMAX_HEADER
+#define SOFTMAX_HEADER
+
+#include <string>
+
+/*
+ * Normalize the class scores of n samples into probabilities in place,
+ * subtracting the maximum of each sample first. y is class-major: the
+ * score of class c of sample i is y[c * ld + i], so consecutive samples
+ * fill the SIMD lanes. If label is not NULL, return the sum of the log
+ * probabilities of label[i], otherwise return 0
+ */
+double softmax(double *y, int classes, int n, int ld, const int *label);
+/*
+ * the single precision version, twice as many samples per vector
+ */
+double softmax(float *y, int classes, int n, int ld, const int *label);
+
+/*
+ * choose the implementation: "auto" picks the widest one the cpu
+ * supports, or force one of "avx512", "avx2", "scalar".
+ * return the name of the chosen implementation. Called once by each
+ * program before it builds its models, which all share the choice
+ */
+const char *softmax_select(const std::string &isa);
+/*
+ * the name of the chosen implementation, choosing "auto" if none is
+ */
+const char *softmax_selected();
+
+#endif
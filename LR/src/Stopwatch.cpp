@@ -4,15 +4,28 @@
  */
 
 #include "Stopwatch.h"
+#include <chrono>
+#include <ctime>
+
+double wall_time() {
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double thread_cpu_time() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
 Stopwatch::Stopwatch() {
-    m_start_time = std::clock();
+    m_start_time = wall_time();
 }
 
 double Stopwatch::time() {
-    return (std::clock() - m_start_time) / (double) CLOCKS_PER_SEC;
+    return wall_time() - m_start_time;
 }
 
 void Stopwatch::restart() {
-    m_start_time = std::clock();
+    m_start_time = wall_time();
 }
@@ -1,12 +1,20 @@
 /*
  * Stopwatch.h
- * The declaration of class stopwatch
+ * The declaration of class stopwatch and the clocks it reads
  */
 
 #ifndef STOPWATCH_HEADER
 #define STOPWATCH_HEADER
 
-#include <ctime>
+/*
+ * seconds of wall time since an arbitrary start, from a clock that
+ * never jumps
+ */
+double wall_time();
+/*
+ * seconds of cpu time the calling thread used
+ */
+double thread_cpu_time();
 
 /*
  * To show the stop wall time
@@ -17,7 +25,7 @@ class Stopwatch {
         double time();
         void restart();
     private:
-        std::clock_t m_start_time;
+        double m_start_time;
 };
 
 #endif
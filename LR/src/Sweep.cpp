@@ -0,0 +1,205 @@
+/*
+ * Sweep.cpp
+ * The definition of the hyper parameter sweep
+ */
+
+#include "Sweep.h"
+#include "LR.h"
+#include "Utils.h"
+#include "Log.h"
+#include "FeatureHash.h"
+#include "Stopwatch.h"
+#include <vector>
+#include <string>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+using namespace std;
+
+/*
+ * One point of the grid and its score summed over its folds
+ */
+struct SweepPoint {
+    float alpha;
+    float lambda;
+    float momentum;
+    int batch_size;
+
+    int done;
+    double acc;
+    double rmse;
+    double loss;
+    double time;
+};
+
+/*
+ * the comma separated values of list, or value if list is empty
+ */
+template <typename T>
+static vector<T> values(const string &list, T value) {
+    vector<T> v;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (!item.empty()) {
+            v.push_back((T)atof(item.c_str()));
+        }
+    }
+    if (v.empty()) {
+        v.push_back(value);
+    }
+    return v;
+}
+
+template <typename Real>
+void sweep(const Config &cfg) {
+    LOG("start sweep\n");
+    vector<SweepPoint> grid;
+    for (float alpha : values(cfg.sweep_alpha, cfg.alpha)) {
+        for (float lambda : values(cfg.sweep_lambda, cfg.lambda)) {
+            for (float momentum : values(cfg.sweep_momentum,
+                        cfg.momentum)) {
+                for (int batch_size : values(cfg.sweep_batch_size,
+                            cfg.batch_size)) {
+                    SweepPoint p;
+                    p.alpha = alpha;
+                    p.lambda = lambda;
+                    p.momentum = momentum;
+                    p.batch_size = batch_size;
+                    p.done = 0;
+                    p.acc = p.rmse = p.loss = p.time = 0;
+                    grid.push_back(p);
+                }
+            }
+        }
+    }
+
+    // the one load of the data
+    Dataset *train = read_sample((cfg.feature_filename_train
+                + cfg.feature_suffix).c_str(), cfg.thread_cnt,
+            cfg.sample_index);
+    int feature_size = cfg.hash_bits > 0 ? 1 << cfg.hash_bits
+        : cfg.feature_size;
+    prepare_features(*train, feature_size, cfg.class_cnt, cfg.hash_bits,
+            NULL);
+    int folds = max(cfg.folds, 1);
+    // the training rows and the scoring set of each fold
+    vector<vector<int>> rows(folds);
+    vector<Dataset *> holdout(folds);
+    if (cfg.folds > 1) {
+        vector<int> idx(train->size());
+        for (int i=0; i<(int)idx.size(); i++) {
+            idx[i] = i;
+        }
+        random_permutation(idx);
+        for (int f=0; f<folds; f++) {
+            holdout[f] = new Dataset();
+        }
+        for (int i=0; i<(int)idx.size(); i++) {
+            for (int f=0; f<folds; f++) {
+                if (i % folds == f) {
+                    holdout[f]->append(*train, idx[i]);
+                }
+                else {
+                    rows[f].push_back(idx[i]);
+                }
+            }
+        }
+    }
+    else {
+        holdout[0] = read_sample((cfg.feature_filename_dev
+                    + cfg.feature_suffix).c_str(), cfg.thread_cnt,
+                cfg.sample_index);
+        prepare_features(*holdout[0], feature_size, cfg.class_cnt,
+                cfg.hash_bits, NULL);
+    }
+    LOG("%d models, %d folds, %d samples\n", (int)grid.size(), folds,
+            train->size());
+
+    // split the cpus between the models training at the same time
+    int parallel = max(1, min(cfg.sweep_parallel,
+                (int)grid.size() * folds));
+    int threads = max(1, cfg.thread_cnt / parallel);
+    atomic<int> next(0);
+    mutex grid_mutex;
+    vector<thread> runners;
+    for (int r=0; r<parallel; r++) {
+        runners.push_back(thread([&, r] {
+            while (true) {
+                int job = next.fetch_add(1);
+                if (job >= (int)grid.size() * folds) {
+                    break;
+                }
+                int g = job / folds;
+                int f = job % folds;
+                Config c = cfg;
+                c.alpha = grid[g].alpha;
+                c.lambda = grid[g].lambda;
+                c.momentum = grid[g].momentum;
+                c.batch_size = grid[g].batch_size;
+                c.thread_cnt = threads;
+                c.first_cpu = cfg.first_cpu + r * threads;
+                c.model_filename = "";
+                c.sparse_model_filename = "";
+                c.profile_trace = "";
+                c.stream = 0;
+
+                double start = wall_time();
+                double acc;
+                double rmse;
+                double loss;
+                // the iteration logs of models training side by side
+                // would interleave
+                Log::set_quiet(true);
+                {
+                    LR<Real> lr(c);
+                    lr.fit(*train, cfg.folds > 1 ? &rows[f] : NULL);
+                    lr.evaluate(*holdout[f], acc, rmse);
+                    loss = lr.loss_history().back();
+                }
+                Log::set_quiet(false);
+
+                lock_guard<mutex> lock(grid_mutex);
+                SweepPoint &p = grid[g];
+                p.done++;
+                p.acc += acc;
+                p.rmse += rmse;
+                p.loss += loss;
+                p.time += wall_time() - start;
+                LOG("model %d fold %d: alpha %g, lambda %g, momentum %g, "
+                        "batch_size %d, acc: %.5f, rmse: %.5f\n", g + 1,
+                        f + 1, p.alpha, p.lambda, p.momentum,
+                        p.batch_size, acc, rmse);
+            }
+        }));
+    }
+    for (auto &t : runners) {
+        t.join();
+    }
+
+    sort(grid.begin(), grid.end(), [](const SweepPoint &a,
+                const SweepPoint &b) {
+            return a.acc > b.acc || (a.acc == b.acc && a.rmse < b.rmse);
+            });
+    LOG("rank, alpha, lambda, momentum, batch_size, acc, rmse, "
+            "train l, time\n");
+    for (int i=0; i<(int)grid.size(); i++) {
+        const SweepPoint &p = grid[i];
+        LOG("%d, %g, %g, %g, %d, %.5f, %.5f, %.10f, %.2fs\n", i + 1,
+                p.alpha, p.lambda, p.momentum, p.batch_size,
+                p.acc / p.done, p.rmse / p.done, p.loss / p.done,
+                p.time / p.done);
+    }
+
+    for (int f=0; f<folds; f++) {
+        delete holdout[f];
+    }
+    delete train;
+    LOG("finish sweep\n");
+}
+
+template void sweep<double>(const Config &cfg);
+template void sweep<float>(const Config &cfg);
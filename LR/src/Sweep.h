@@ -0,0 +1,25 @@
+/*
+ * Sweep.h
+ * The declaration of the hyper parameter sweep
+ */
+
+#ifndef SWEEP_HEADER
+#define SWEEP_HEADER
+
+#include "Config.h"
+
+/*
+ * Train a model for every combination of the sweep_alpha,
+ * sweep_lambda, sweep_momentum and sweep_batch_size values and log a
+ * leaderboard of their accuracy. The training set, and the dev set or
+ * the folds, are loaded once and shared by all models. sweep_parallel
+ * models train at the same time, each on its own thread_cnt /
+ * sweep_parallel cpus. With folds > 1 every combination is trained
+ * folds times, holding out one fold each time, and scored on the
+ * held-out folds, else it is trained on the training set and scored on
+ * the dev set
+ */
+template <typename Real>
+void sweep(const Config &cfg);
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ * ThreadPool.cpp
+ * The definition of class Barrier and class ThreadPool
+ */
+
+#include "ThreadPool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+
+void parallel_range(size_t n, int thread_cnt,
+        const std::function<void(size_t, size_t)> &job) {
+    thread_cnt = std::max(thread_cnt, 1);
+    std::vector<std::thread> threads;
+    std::vector<const char *> errors(thread_cnt, NULL);
+    for (int t=0; t<thread_cnt; t++) {
+        size_t st = n * t / thread_cnt;
+        size_t ed = n * (t + 1) / thread_cnt;
+        auto run = [&job, &errors, t, st, ed] {
+            try {
+                job(st, ed);
+            }
+            catch (const char *e) {
+                errors[t] = e;
+            }
+        };
+        if (t + 1 < thread_cnt) {
+            threads.push_back(std::thread(run));
+        }
+        else {
+            run();
+        }
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    for (const char *e : errors) {
+        if (e != NULL) {
+            throw e;
+        }
+    }
+}
+
+Barrier::Barrier(int count) {
+    m_count = count;
+    m_waiting = 0;
+    m_generation = 0;
+}
+
+void Barrier::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    int generation = m_generation;
+    if (++m_waiting == m_count) {
+        m_waiting = 0;
+        m_generation++;
+        m_cond.notify_all();
+        return;
+    }
+    while (generation == m_generation) {
+        m_cond.wait(lock);
+    }
+}
+
+ThreadPool::ThreadPool(int thread_cnt, bool pin, int first_cpu)
+    : m_start(thread_cnt + 1), m_finish(thread_cnt + 1) {
+    m_job = NULL;
+    m_stop = false;
+    // the cpus of the affinity mask, which taskset or a cgroup may
+    // have narrowed to a few that are not 0 .. n - 1
+    std::vector<int> cpus;
+    cpu_set_t allowed;
+    if (pin && sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int c=0; c<CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &allowed)) {
+                cpus.push_back(c);
+            }
+        }
+    }
+    for (int i=0; i<thread_cnt; i++) {
+        m_threads.push_back(std::thread(&ThreadPool::worker, this, i));
+        if (!cpus.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[(first_cpu + i) % cpus.size()], &set);
+            // pinning is only a hint, keep running if it is refused
+            pthread_setaffinity_np(m_threads[i].native_handle(),
+                    sizeof(set), &set);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    m_stop = true;
+    m_start.wait();
+    for (auto &t : m_threads) {
+        t.join();
+    }
+}
+
+void ThreadPool::run(const std::function<void(int)> &job) {
+    m_job = &job;
+    m_start.wait();
+    m_finish.wait();
+    m_job = NULL;
+}
+
+void ThreadPool::worker(int thread_id) {
+    while (true) {
+        m_start.wait();
+        if (m_stop) {
+            return;
+        }
+        (*m_job)(thread_id);
+        m_finish.wait();
+    }
+}
@@ -0,0 +1,90 @@
+/*
+ * ThreadPool.h
+ * The declaration of class Barrier and class ThreadPool
+ */
+
+#ifndef THREAD_POOL_HEADER
+#define THREAD_POOL_HEADER
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * A value alone on its cache line, so per-thread accumulators
+ * stored in an array do not false-share
+ */
+template <typename T>
+struct Padded {
+    T v;
+    char pad[CACHE_LINE_SIZE - sizeof(T) % CACHE_LINE_SIZE];
+};
+
+/*
+ * Split [0, n) into thread_cnt contiguous ranges and run job(st, ed)
+ * on each, one of them on the calling thread. Return when all are done
+ * and throw the error of a job that threw
+ */
+void parallel_range(size_t n, int thread_cnt,
+        const std::function<void(size_t, size_t)> &job);
+
+/*
+ * A reusable barrier for a fixed number of threads
+ */
+class Barrier {
+    public:
+        Barrier(int count);
+        /*
+         * block until all threads arrived
+         */
+        void wait();
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        int m_count;
+        int m_waiting;
+        int m_generation;
+};
+
+/*
+ * A fixed set of worker threads that live as long as the pool.
+ * Each call of run() is one barrier-synchronized round in which every
+ * worker executes the job once
+ */
+class ThreadPool {
+    public:
+        /*
+         * start thread_cnt workers. When pin is set worker i is pinned
+         * to cpu first_cpu + i of the cpus the process may run on,
+         * wrapping around them
+         */
+        ThreadPool(int thread_cnt, bool pin, int first_cpu = 0);
+        ~ThreadPool();
+
+        /*
+         * run job(thread_id) on every worker, return when all finished
+         */
+        void run(const std::function<void(int)> &job);
+
+        int size() const {
+            return m_threads.size();
+        }
+    private:
+        ThreadPool(const ThreadPool &);
+        ThreadPool &operator=(const ThreadPool &);
+
+        void worker(int thread_id);
+
+        std::vector<std::thread> m_threads;
+        // the workers and the caller of run() meet here
+        Barrier m_start;
+        Barrier m_finish;
+        const std::function<void(int)> *m_job;
+        bool m_stop;
+};
+
+#endif
@@ -4,6 +4,7 @@
  */
 
 #include "Utils.h"
+#include "CompactFile.h"
 #include <unordered_set>
 #include <fstream>
 #include <assert.h>
@@ -11,37 +12,24 @@
 
 using namespace std;
 
-vector<Sample*> read_sample(const char *infilename) {
-    FILE *infile = fopen(infilename, "rb");
-
-    int MAXLEN = 500 << 20; // 500 MB buffer
-    char *buf = new char[MAXLEN];
-    int n = fread(buf, 1, MAXLEN, infile);
-    assert(n < MAXLEN);
-
-    fclose(infile);
-
-    vector<Sample*> samples;
-
-    for (int i=0; i<n; ) {
-        int len;
-        memcpy(&len, buf + i, sizeof(int));
-        Sample *s = new Sample();
-        memcpy(&s->label, buf + i + sizeof(int), sizeof(int));
-        s->label--;
-        int m = len / sizeof(int) / 2 - 1;
-        s->feat.resize(m);
-        memcpy(s->feat.data(), buf + i + sizeof(int) + sizeof(int), 
-                sizeof(int) * 2 * m);
-        for (auto &p : s->feat) {
-            p.first--;
+Dataset *read_sample(const char *infilename, int thread_cnt,
+        bool use_index) {
+    if (is_compact_file(infilename)) {
+        // the block table of the compact format is its index
+        CompactFile file(infilename);
+        Dataset *data = new Dataset();
+        try {
+            file.decode(*data, thread_cnt);
         }
-
-        i += len;
-        samples.push_back(s);
+        catch (const char *e) {
+            delete data;
+            throw;
+        }
+        return data;
     }
-
-    return samples;
+    // the mapping is only needed while packing
+    SampleFile file(infilename, use_index);
+    return new Dataset(file, thread_cnt);
 }
 
 void random_permutation(std::vector<int> &x) {
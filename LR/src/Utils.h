@@ -7,14 +7,19 @@
 #define UTILS_HEADER
 #include "Config.h"
 #include "Sample.h"
+#include "Dataset.h"
 #include <vector>
 #include <string>
 #include <unordered_map>
 
 /*
- * read the samples from file
+ * map the samples from file and pack them into a CSR dataset on
+ * thread_cnt threads. The file is in the .bin format, read with the
+ * offset index sidecar if use_index is set, see SampleFile, or in the
+ * compact format, see CompactFile
  */
-std::vector<Sample*> read_sample(const char *infilename);
+Dataset *read_sample(const char *infilename, int thread_cnt = 1,
+        bool use_index = false);
 
 /*
  * random permutation the array in O(n) time